@@ -0,0 +1,191 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines AnchorIndex, which finds the arrows anchored to boxes, as
+ * well as functions for anchoring arrows to boxes.
+ *
+ * An arrow's end is anchored to a box by the box's key (see Box::key), which
+ * stays the same however the elements are reordered. The arrow still stores
+ * where its ends are, so an anchor only matters when the box is moved, at
+ * which point the ends anchored to it are moved with it (see Arrow::follow).
+ * Anchors to boxes which no longer exist are ignored.
+ */
+
+#include "base.hpp"
+#include "drawable.hpp"
+
+#include "item/arrow.hpp"
+#include "item/box.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Call \p visit with each Box in \p elem (including \p elem itself), looking
+ * inside groups.
+ */
+template <typename F>
+void for_each_box(const Drawable& elem, F&& visit)
+{
+	if(auto* group = dynamic_cast<const ElementStack*>(&elem)) {
+		for(auto& inner : group->elements) {
+			for_each_box(*inner, visit);
+		}
+	} else if(auto* box = dynamic_cast<const Box*>(&elem)) {
+		visit(*box);
+	}
+}
+
+/**
+ * Get a key which no box in \p es has, and which no arrow is anchored to (so
+ * that those arrows don't suddenly follow a new box).
+ */
+inline std::uint32_t next_anchor_key(const ElementStack& es)
+{
+	std::uint32_t most = 0;
+	for(auto& elem : es.elements) {
+		if(auto* group = dynamic_cast<const ElementStack*>(elem.get())) {
+			most = std::max(most, next_anchor_key(*group) - 1);
+		} else if(auto* box = dynamic_cast<const Box*>(elem.get())) {
+			most = std::max(most, box->key);
+		} else if(auto* arrow = dynamic_cast<const Arrow*>(elem.get())) {
+			most = std::max({ most, arrow->start_box, arrow->end_box });
+		}
+	}
+	return most + 1;
+}
+
+/**
+ * Get the index of the topmost box in \p es (not in a group, and other than
+ * the element \p skip) which \p pos is on the side of, either on its border
+ * or just outside it, or -1 if there isn't one. This is the box an arrow
+ * ending at \p pos is anchored to.
+ */
+inline int anchor_box_at(const ElementStack& es, point pos, int skip)
+{
+	for(int idx = static_cast<int>(es.elements.size()) - 1; idx >= 0; --idx) {
+		auto* box = dynamic_cast<const Box*>(es.elements[idx].get());
+		if(!box || idx == skip) {
+			continue;
+		}
+		int x1 = std::min(box->x1, box->x2), x2 = std::max(box->x1, box->x2);
+		int y1 = std::min(box->y1, box->y2), y2 = std::max(box->y1, box->y2);
+		bool near = x1 - 1 <= pos.x && pos.x <= x2 + 1 && y1 - 1 <= pos.y && pos.y <= y2 + 1;
+		bool inside = x1 < pos.x && pos.x < x2 && y1 < pos.y && pos.y < y2;
+		if(near && !inside) {
+			return idx;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Prepare \p pasted, a copy of elements about to be added to \p es, so that
+ * its anchors don't get mixed up with those already there.
+ *
+ * Boxes keep their keys, unless a box in \p es has the same one, in which
+ * case it is replaced with a new key. Arrows stay anchored to boxes pasted
+ * with them, and are detached from any others.
+ */
+inline void rekey_pasted(Drawable& pasted, const ElementStack& es)
+{
+	std::unordered_set<std::uint32_t> used;
+	for(auto& elem : es.elements) {
+		for_each_box(*elem, [&] (const Box& box) {
+			used.insert(box.key);
+		});
+	}
+
+	std::uint32_t next = next_anchor_key(es);
+	std::unordered_map<std::uint32_t, std::uint32_t> renamed; // old keys to new
+	std::vector<Arrow*> arrows;
+
+	auto visit = [&] (Drawable& elem, auto& recurse) -> void {
+		if(auto* group = dynamic_cast<ElementStack*>(&elem)) {
+			for(auto& inner : group->elements) {
+				recurse(*inner, recurse);
+			}
+		} else if(auto* box = dynamic_cast<Box*>(&elem)) {
+			if(box->key != 0) {
+				std::uint32_t key = used.count(box->key) ? next++ : box->key;
+				renamed[box->key] = key;
+				box->key = key;
+			}
+		} else if(auto* arrow = dynamic_cast<Arrow*>(&elem)) {
+			arrows.push_back(arrow);
+		}
+	};
+	visit(pasted, visit);
+
+	auto rename = [&] (std::uint32_t key) {
+		auto it = renamed.find(key);
+		return it == renamed.end() ? 0 : it->second;
+	};
+	for(auto* arrow : arrows) {
+		arrow->start_box = rename(arrow->start_box);
+		arrow->end_box = rename(arrow->end_box);
+	}
+}
+
+/**
+ * The arrows (not in groups) of a stack anchored to each box, so that when a
+ * box is moved, the arrows to move with it are found without looking at any
+ * others.
+ */
+struct AnchorIndex
+{
+	std::unordered_map<std::uint32_t, std::vector<int>> arrows; // by key, in order
+public:
+	/**
+	 * Index the arrows of \p es.
+	 */
+	void build(const ElementStack& es)
+	{
+		arrows.clear();
+		for(size_t idx = 0; idx < es.elements.size(); ++idx) {
+			auto* arrow = dynamic_cast<const Arrow*>(es.elements[idx].get());
+			if(!arrow) {
+				continue;
+			}
+			if(arrow->start_box != 0) {
+				arrows[arrow->start_box].push_back(idx);
+			}
+			if(arrow->end_box != 0 && arrow->end_box != arrow->start_box) {
+				arrows[arrow->end_box].push_back(idx);
+			}
+		}
+	}
+
+	/**
+	 * Get the arrows anchored to the box \p key.
+	 */
+	const std::vector<int>& anchored_to(std::uint32_t key) const
+	{
+		static const std::vector<int> none;
+		auto it = arrows.find(key);
+		return it == arrows.end() ? none : it->second;
+	}
+
+	/**
+	 * Get the arrows (in order) anchored to the boxes in \p elem, which is
+	 * the element \p id, not including \p elem itself.
+	 */
+	std::vector<int> anchored_to(const Drawable& elem, int id) const
+	{
+		std::vector<int> out;
+		for_each_box(elem, [&] (const Box& box) {
+			if(box.key != 0) {
+				auto& found = this->anchored_to(box.key);
+				out.insert(out.end(), found.begin(), found.end());
+			}
+		});
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+		out.erase(std::remove(out.begin(), out.end(), id), out.end());
+		return out;
+	}
+};
@@ -1,55 +1,248 @@
 #pragma once
 
+/**
+ * \file
+ * This file defines CellRenderer, a Canvas which renders a region into a
+ * buffer of cells, and AsciiRenderer, which renders a region to plain text.
+ */
+
+#include "base.hpp"
 #include "canvas.hpp"
+#include "cell.hpp"
+#include "lines.hpp"
 
 #include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
 
 /**
- * Render a rectangular region as plain text.
+ * Render a rectangular region into a buffer of cells of type \p Cell (see
+ * CellTraits), such as char for plain text.
  *
  * This Canvas takes an inclusive rectangular region, and draws elements into
- * that region.  This is useful for when copying to clipboard.
+ * that region.
+ *
+ * The cells of the whole region are allocated upfront (and reused by reset()),
+ * so drawing is done with plain memory writes, clipped once per primitive.
+ * This suits regions the size of a screen; larger ones are exported a band of
+ * rows at a time (see export_region()). For each row, the extent up to the
+ * last cell drawn is tracked, so that unused space on the right isn't output.
+ * Lines drawn with joinh() and joinv() are joined up where they cross or meet
+ * (see Junctions).
+ *
+ * Each kernel is specialized for the type of cell at compile time, so wider
+ * cells cost nothing when rendering plain text. Cells which have a colour
+ * (see Styled) are drawn with the canvas' pen.
  */
-struct AsciiRenderer
+template <typename Cell>
+struct CellRenderer
 	: public Canvas
 {
+	using Traits = CellTraits<Cell>;
+
 	point min, max; // half-open range
-	std::vector<std::string> lines;
+	std::vector<Cell> cells; // row-major, initially blank
+	std::vector<int> used; // for each row, the number of cells up to the last one drawn
+	Junctions junctions;
 public:
 	// min{x,y}/max{x,y} here are inclusive, so we need to change the range a bit
-	AsciiRenderer(int x1, int y1, int x2, int y2)
-		: min(std::min(x1, x2), std::min(y1, y2))
-		, max(std::max(x1, x2) + 1, std::max(y1, y2) + 1)
-		, lines(max.y - min.y)
+	CellRenderer(int x1, int y1, int x2, int y2)
 	{
+		this->reset(x1, y1, x2, y2);
 	}
 
 	/**
-	 * Ensure that a given line \p lineno is at least \p length long.
+	 * Clear the canvas and change the region to (\p x1, \p y1) to (\p x2,
+	 * \p y2) inclusive. The memory already allocated is reused.
 	 */
-	void extend_line(int lineno, size_t length)
+	void reset(int x1, int y1, int x2, int y2)
 	{
-		auto& line = lines[lineno];
-		if(line.size() <= length) {
-			line.resize(length + 1, ' ');
-		}
+		min = { std::min(x1, x2), std::min(y1, y2) };
+		max = { std::max(x1, x2) + 1, std::max(y1, y2) + 1 };
+		cells.assign(static_cast<size_t>(this->width()) * this->height(), Traits::blank());
+		used.assign(this->height(), 0);
+		junctions.reset(this->width(), this->height());
+		this->set_visible(min.x, min.y, max.x - 1, max.y - 1);
+	}
+
+	int width() const { return max.x - min.x; }
+	int height() const { return max.y - min.y; }
+
+	/**
+	 * Get the start of the rendered row \p row (relative to the top of the
+	 * region), which has row_length() cells drawn.
+	 */
+	const Cell* row(int row) const
+	{
+		return cells.data() + static_cast<size_t>(row) * this->width();
+	}
+
+	/**
+	 * Get the number of cells in row \p row, up to the last one drawn.
+	 */
+	int row_length(int row) const
+	{
+		return used[row];
+	}
+
+protected:
+	/**
+	 * Get the cell at (\p x, \p y), which must be in the region, marking
+	 * the row as used up to \p last_x (inclusive).
+	 */
+	Cell* cell(int x, int y, int last_x)
+	{
+		int row = y - min.y;
+		used[row] = std::max(used[row], last_x - min.x + 1);
+		return &cells[static_cast<size_t>(row) * this->width() + (x - min.x)];
+	}
+
+	/**
+	 * Get the cells from (\p x, \p y) to (\p last_x, \p y), as cell(),
+	 * which are about to be drawn over, so no longer have lines through
+	 * them.
+	 */
+	Cell* cover(int x, int y, int last_x)
+	{
+		junctions.clear(x - min.x, y - min.y, last_x - x + 1);
+		return this->cell(x, y, last_x);
 	}
 
-	// TODO: Make more efficient if needed
 	virtual void impl_set(char fill, int x, int y) override
+	{
+		if(x < min.x || max.x <= x || y < min.y || max.y <= y) {
+			return;
+		}
+		*this->cover(x, y, x) = Traits::widen(fill, pen);
+	}
+
+	virtual void impl_linev(char fill, int x, int y1, int y2) override
 	{
 		if(x < min.x || max.x <= x) {
 			return;
 		}
+		y1 = std::max(y1, min.y);
+		y2 = std::min(y2, max.y - 1);
+		for(int y = y1; y <= y2; ++y) {
+			*this->cover(x, y, x) = Traits::widen(fill, pen);
+		}
+	}
+
+	virtual void impl_lineh(char fill, int x1, int y, int x2) override
+	{
+		if(y < min.y || max.y <= y) {
+			return;
+		}
+		x1 = std::max(x1, min.x);
+		x2 = std::min(x2, max.x - 1);
+		if(x1 <= x2) {
+			Traits::fill(this->cover(x1, y, x2), fill, pen, x2 - x1 + 1);
+		}
+	}
+
+	virtual void impl_fill(char fill, int x1, int y1, int x2, int y2) override
+	{
+		x1 = std::max(x1, min.x);
+		x2 = std::min(x2, max.x - 1);
+		y1 = std::max(y1, min.y);
+		y2 = std::min(y2, max.y - 1);
+		if(x1 > x2) {
+			return;
+		}
+		for(int y = y1; y <= y2; ++y) {
+			Traits::fill(this->cover(x1, y, x2), fill, pen, x2 - x1 + 1);
+		}
+	}
 
+	virtual void impl_direct(strview str, int x, int y) override
+	{
 		if(y < min.y || max.y <= y) {
 			return;
 		}
+		int first = std::max(x, min.x) - x;
+		int last = std::min(x + static_cast<int>(str.size()), max.x) - x - 1;
+		if(first <= last) {
+			Traits::copy(this->cover(x + first, y, x + last), str.data() + first, pen, last - first + 1);
+		}
+	}
 
-		point offset = { x - min.x, y - min.y };
+	virtual void impl_blit(const char* src, const std::uint8_t* links, const Pen* pens,
+		int length, int x, int y) override
+	{
+		if(y < min.y || max.y <= y) {
+			return;
+		}
+
+		// clip to the region
+		int first = std::max(x, min.x) - x;
+		int last = std::min(x + length, max.x) - x - 1;
 
-		this->extend_line(offset.y, offset.x);
-		lines[offset.y][offset.x] = fill;
+		// don't extend the line for trailing transparent cells
+		while(first <= last && src[last] == Transparent) {
+			--last;
+		}
+		if(first > last) {
+			return;
+		}
+
+		Cell* dst = this->cell(x + first, y, x + last);
+		Traits::blit(dst, src + first, pens ? pens + first : nullptr, last - first + 1);
+
+		// the lines drawn replace any underneath
+		for(int idx = first; idx <= last; ++idx) {
+			if(src[idx] != Transparent) {
+				std::uint8_t mask = links ? links[idx] : 0;
+				junctions.set(x + idx - min.x, y - min.y, mask);
+				if(mask) {
+					dst[idx - first] = Traits::line(src[idx], mask, pens ? pens[idx] : pen);
+				}
+			}
+		}
+	}
+
+	virtual void impl_joinh(const LineGlyphs& glyphs, int x1, int y, int x2) override
+	{
+		if(y < min.y || max.y <= y || x2 < min.x || max.x <= x1) {
+			return;
+		}
+		this->cell(std::max(x1, min.x), y, std::min(x2, max.x - 1));
+		junctions.joinh(cells.data(), glyphs, pen, x1 - min.x, y - min.y, x2 - min.x);
+	}
+
+	virtual void impl_joinv(const LineGlyphs& glyphs, int x, int y1, int y2) override
+	{
+		if(x < min.x || max.x <= x || y2 < min.y || max.y <= y1) {
+			return;
+		}
+		for(int y = std::max(y1, min.y); y <= std::min(y2, max.y - 1); ++y) {
+			this->cell(x, y, x);
+		}
+		junctions.joinv(cells.data(), glyphs, pen, x - min.x, y1 - min.y, y2 - min.y);
+	}
+};
+
+/**
+ * Render a rectangular region as plain text.
+ *
+ * This is useful for when copying to clipboard, or exporting.
+ */
+struct AsciiRenderer
+	: public CellRenderer<char>
+{
+public:
+	AsciiRenderer(int x1, int y1, int x2, int y2)
+		: CellRenderer(x1, y1, x2, y2)
+	{
+	}
+
+	/**
+	 * Get the rendered row \p row (relative to the top of the region), up
+	 * to the last cell drawn.
+	 */
+	strview line(int row) const
+	{
+		return { this->row(row), static_cast<size_t>(used[row]) };
 	}
 
 	/**
@@ -57,11 +250,24 @@ public:
 	 */
 	std::string joined() const
 	{
-		std::string out;
-		for(auto& line : lines) {
-			out += line;
-			out += '\n';
+		size_t total = this->height(); // newlines
+		for(int length : used) {
+			total += length;
+		}
+
+		std::string out(total, '\n');
+		char* pos = &out[0];
+		for(int row = 0; row < this->height(); ++row) {
+			strview text = this->line(row);
+			std::memcpy(pos, text.data(), text.size());
+			pos += text.size() + 1; // skip the newline
 		}
 		return out;
 	}
 };
+
+/**
+ * Render a rectangular region as Unicode, with lines drawn as box drawing
+ * characters (see CellTraits<char32_t>).
+ */
+using UnicodeRenderer = CellRenderer<char32_t>;
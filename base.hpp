@@ -5,6 +5,11 @@
  * This file defines generic types widely used throughout the project.
  */
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
 /**
  * Stores a coordinate pair of integers.
  *
@@ -17,8 +22,89 @@ struct point
 public:
 	point() = default;
 
-	point(int x, int y)
+	constexpr point(int x, int y)
 		: x(x), y(y)
 	{
 	}
 };
+
+/**
+ * A non-owning reference to a sequence of chars.
+ *
+ * This is a minimal version of C++17's std::string_view, used to refer to
+ * text without copying it (e.g. text stored in a memory-mapped file).
+ */
+struct strview
+{
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	const char* ptr;
+	size_t len;
+public:
+	constexpr strview()
+		: ptr(nullptr), len(0)
+	{
+	}
+
+	constexpr strview(const char* ptr, size_t len)
+		: ptr(ptr), len(len)
+	{
+	}
+
+	strview(const char* str)
+		: ptr(str), len(std::strlen(str))
+	{
+	}
+
+	strview(const std::string& str)
+		: ptr(str.data()), len(str.size())
+	{
+	}
+
+	const char* data() const { return ptr; }
+	size_t size() const { return len; }
+	bool empty() const { return len == 0; }
+	const char* begin() const { return ptr; }
+	const char* end() const { return ptr + len; }
+	char operator[](size_t idx) const { return ptr[idx]; }
+
+	/**
+	 * Find the first \p c at or after \p start, returning npos if there is
+	 * none.
+	 */
+	size_t find(char c, size_t start = 0) const
+	{
+		if(start >= len) {
+			return npos;
+		}
+		auto found = static_cast<const char*>(std::memchr(ptr + start, c, len - start));
+		return found ? static_cast<size_t>(found - ptr) : npos;
+	}
+
+	/**
+	 * Get up to \p count chars starting from \p start.
+	 */
+	strview substr(size_t start, size_t count = npos) const
+	{
+		start = std::min(start, len);
+		return { ptr + start, std::min(count, len - start) };
+	}
+
+	/**
+	 * Copy the referenced chars into a std::string.
+	 */
+	std::string str() const
+	{
+		return std::string(ptr, len);
+	}
+
+	bool operator==(strview other) const
+	{
+		return len == other.len && (len == 0 || std::memcmp(ptr, other.ptr, len) == 0);
+	}
+
+	bool operator!=(strview other) const
+	{
+		return !(*this == other);
+	}
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines low level kernels for copying rows of cells, which are
+ * used when compositing cached rasters.
+ */
+
+#include <cstddef>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Copy \p count cells from \p src to \p dst, except for the Transparent ('\0')
+ * cells in \p src, which leave the corresponding cell in \p dst untouched.
+ *
+ * When SSE2 is available, this processes 16 cells at once.
+ */
+inline void masked_blit(char* dst, const char* src, size_t count)
+{
+	size_t idx = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	for(; idx + 16 <= count; idx += 16) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + idx));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + idx));
+		__m128i transparent = _mm_cmpeq_epi8(s, zero);
+		// keep dst where src is transparent, otherwise take src
+		__m128i out = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx), out);
+	}
+#endif
+
+	for(; idx < count; ++idx) {
+		if(src[idx] != '\0') {
+			dst[idx] = src[idx];
+		}
+	}
+}
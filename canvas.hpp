@@ -6,10 +6,16 @@
  * to.
  */
 
-#include "drawable.hpp"
+#include "base.hpp"
+#include "lines.hpp"
+#include "multistyle.hpp"
 
 #include <string>
 #include <algorithm>
+#include <climits>
+#include <vector>
+
+struct Drawable; // forward declare
 
 /**
  * An interface for a drawing target for Drawables.
@@ -20,6 +26,11 @@
  *
  * Drawables can use most public methods for drawing themselves. These are
  * delegated to the corresponding virtual methods.
+ *
+ * Elements refer to their styles by StyleId, so \a styles must be set to the
+ * styles of the document before drawing anything with a style. Looking up a
+ * style also sets \a pen to its colour, which canvases that have colour draw
+ * with.
  */
 struct Canvas
 {
@@ -30,6 +41,21 @@ struct Canvas
 		Blank       = ' '   ///< Appears as blank.
 	};
 
+	/// The styles which the StyleIds of elements refer to.
+	const MultiStyleManager* styles = nullptr;
+
+	/// If not null, every style looked up through style() is added to this.
+	std::vector<const Style*>* used_styles = nullptr;
+
+	/// The colour being drawn with, from the last style looked up (or the
+	/// default colour, at the start of each element drawn).
+	Pen pen = 0;
+
+	/// The region (inclusive) where drawing has any effect. Drawables may
+	/// skip parts of themselves outside of it, but don't have to.
+	point visible_min = { INT_MIN, INT_MIN };
+	point visible_max = { INT_MAX, INT_MAX };
+
 protected:
 
 	/**
@@ -87,13 +113,65 @@ protected:
 	 *
 	 * The implementer may assume that \p str is not empty.
 	 */
-	virtual void impl_direct(const std::string& str, int x, int y)
+	virtual void impl_direct(strview str, int x, int y)
 	{
 		for(unsigned int idx = 0; idx < str.size(); ++idx) {
 			this->impl_set(str[idx], x + idx, y);
 		}
 	}
 
+	/**
+	 * Write a row of \p length cells from \p cells to the canvas, with the
+	 * first one at (\p x, \p y). Unlike impl_direct, Transparent cells
+	 * are skipped, leaving what is underneath visible.
+	 *
+	 * If \p links isn't null, it has the directions lines leave each cell
+	 * in (see Junctions), for canvases which join lines. If \p pens isn't
+	 * null, it has the pen each cell was drawn with, instead of \a pen.
+	 *
+	 * The implementer may assume that \p length > 0.
+	 */
+	virtual void impl_blit(const char* cells, const std::uint8_t* /* links */, const Pen* pens,
+		int length, int x, int y)
+	{
+		for(int idx = 0; idx < length; ++idx) {
+			if(cells[idx] != Transparent) {
+				if(pens) {
+					pen = pens[idx];
+				}
+				this->impl_set(cells[idx], x + idx, y);
+			}
+		}
+	}
+
+	/**
+	 * Draw a horizontal line from (\p x1, \p y) to (\p x2, \p y) inclusive
+	 * with \p glyphs, joined up with the other lines drawn this way
+	 * through the same cells (see Junctions).
+	 *
+	 * By default, lines aren't joined: each cell just gets the glyph for
+	 * this line. The implementer may assume that \p x1 <= \p x2.
+	 */
+	virtual void impl_joinh(const LineGlyphs& glyphs, int x1, int y, int x2)
+	{
+		for(int x = x1; x <= x2; ++x) {
+			this->set(x1 == x2 ? glyphs.parts[LineGlyphs::Horizontal] : glyphs[line_links(x, x1, x2, LineLeft, LineRight)], x, y);
+		}
+	}
+
+	/**
+	 * Draw a vertical line from (\p x, \p y1) to (\p x, \p y2) inclusive
+	 * with \p glyphs, joined up with other lines (see impl_joinh()).
+	 *
+	 * The implementer may assume that \p y1 <= \p y2.
+	 */
+	virtual void impl_joinv(const LineGlyphs& glyphs, int x, int y1, int y2)
+	{
+		for(int y = y1; y <= y2; ++y) {
+			this->set(y1 == y2 ? glyphs.parts[LineGlyphs::Vertical] : glyphs[line_links(y, y1, y2, LineUp, LineDown)], x, y);
+		}
+	}
+
 public:
 
 	virtual ~Canvas() = default;
@@ -148,7 +226,7 @@ public:
 	 * (e.g. a newline) is unspecified. This includes the Transparent
 	 * character.
 	 */
-	void direct(const std::string& s, int x, int y)
+	void direct(strview s, int x, int y)
 	{
 		if(!s.empty()) {
 			this->impl_direct(s, x, y);
@@ -156,11 +234,153 @@ public:
 	}
 
 	/**
-	 * Draw \p object onto the current canvas. This is the same as calling
-	 * draw on \p object with *this as the argument.
+	 * Draw a horizontal line from (\p x1, \p y) to (\p x2, \p y) inclusive
+	 * with \p glyphs. Where it crosses or meets other lines drawn with
+	 * joinh() or joinv(), the cell gets a corner or junction glyph instead,
+	 * if the canvas supports it.
+	 */
+	void joinh(const LineGlyphs& glyphs, int x1, int y, int x2)
+	{
+		this->impl_joinh(glyphs, std::min(x1, x2), y, std::max(x1, x2));
+	}
+
+	/**
+	 * Draw a vertical line from (\p x, \p y1) to (\p x, \p y2) inclusive
+	 * with \p glyphs, joined up with other lines (see joinh()).
+	 */
+	void joinv(const LineGlyphs& glyphs, int x, int y1, int y2)
+	{
+		this->impl_joinv(glyphs, x, std::min(y1, y2), std::max(y1, y2));
+	}
+
+	/**
+	 * Limit the visible region to (\p x1, \p y1) to (\p x2, \p y2)
+	 * inclusive. The corners must already be ordered.
+	 */
+	void set_visible(int x1, int y1, int x2, int y2)
+	{
+		visible_min = { x1, y1 };
+		visible_max = { x2, y2 };
+	}
+
+	/**
+	 * Write a row of \p length cells to the canvas, with the first one at
+	 * (\p x, \p y). Transparent cells are skipped. \p links and \p pens
+	 * optionally have the directions of the lines through each cell, and
+	 * the pen it is drawn with.
+	 */
+	void blit(const char* cells, const std::uint8_t* links, const Pen* pens, int length, int x, int y)
+	{
+		if(length > 0) {
+			this->impl_blit(cells, links, pens, length, x, y);
+		}
+	}
+
+	/**
+	 * Get the style referred to by \p id, for drawing with. The pen is set
+	 * to its colour.
+	 */
+	template <typename T>
+	const T& style(StyleId<T> id)
+	{
+		const T& found = styles->get<T>().table[id];
+		if(used_styles) {
+			used_styles->push_back(&found);
+		}
+		pen = pen_of(found.colour);
+		return found;
+	}
+
+	/**
+	 * Draw \p object onto the current canvas, starting with the default
+	 * pen. This is the same as calling draw on \p object with *this as the
+	 * argument.
+	 *
+	 * This is defined in drawable.hpp, as Drawable is incomplete here.
+	 */
+	void draw(const Drawable& object);
+};
+
+/**
+ * Draw onto another canvas, translating everything by a fixed offset.
+ *
+ * This is used to apply a translation lazily (e.g. for groups), instead of
+ * modifying the coordinates of every element being drawn.
+ */
+struct OffsetCanvas
+	: public Canvas
+{
+	Canvas& target;
+	point offset;
+public:
+	OffsetCanvas(Canvas& target, point offset)
+		: target(target), offset(offset)
+	{
+		styles = target.styles;
+		used_styles = target.used_styles;
+		visible_min = { untranslate(target.visible_min.x, offset.x), untranslate(target.visible_min.y, offset.y) };
+		visible_max = { untranslate(target.visible_max.x, offset.x), untranslate(target.visible_max.y, offset.y) };
+	}
+
+protected:
+	virtual void impl_set(char fill, int x, int y) override
+	{
+		this->out().set(fill, x + offset.x, y + offset.y);
+	}
+
+	virtual void impl_linev(char fill, int x, int y1, int y2) override
+	{
+		this->out().linev(fill, x + offset.x, y1 + offset.y, y2 + offset.y);
+	}
+
+	virtual void impl_lineh(char fill, int x1, int y, int x2) override
+	{
+		this->out().lineh(fill, x1 + offset.x, y + offset.y, x2 + offset.x);
+	}
+
+	virtual void impl_fill(char fill, int x1, int y1, int x2, int y2) override
+	{
+		this->out().fill(fill, x1 + offset.x, y1 + offset.y, x2 + offset.x, y2 + offset.y);
+	}
+
+	virtual void impl_direct(strview str, int x, int y) override
+	{
+		this->out().direct(str, x + offset.x, y + offset.y);
+	}
+
+	virtual void impl_blit(const char* cells, const std::uint8_t* links, const Pen* pens,
+		int length, int x, int y) override
+	{
+		this->out().blit(cells, links, pens, length, x + offset.x, y + offset.y);
+	}
+
+	virtual void impl_joinh(const LineGlyphs& glyphs, int x1, int y, int x2) override
+	{
+		this->out().joinh(glyphs, x1 + offset.x, y + offset.y, x2 + offset.x);
+	}
+
+	virtual void impl_joinv(const LineGlyphs& glyphs, int x, int y1, int y2) override
+	{
+		this->out().joinv(glyphs, x + offset.x, y1 + offset.y, y2 + offset.y);
+	}
+
+private:
+	/**
+	 * Get the target, drawing with the same pen.
+	 */
+	Canvas& out()
+	{
+		target.pen = pen;
+		return target;
+	}
+
+	/**
+	 * Translate the coordinate \p pos of the target by -\p by, saturating
+	 * instead of overflowing (so an unlimited region stays unlimited).
 	 */
-	void draw(const Drawable& object)
+	static int untranslate(int pos, int by)
 	{
-		object.draw(*this);
+		long long moved = static_cast<long long>(pos) - by;
+		return static_cast<int>(std::max<long long>(INT_MIN, std::min<long long>(INT_MAX, moved)));
 	}
 };
@@ -0,0 +1,196 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines CellTraits, the operations on each type of cell that a
+ * buffer of rendered cells can be made of, and Styled, a cell which also has
+ * a colour.
+ */
+
+#include "blit.hpp"
+#include "lines.hpp"
+#include "style.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Plain ASCII cells, which are exactly what elements draw. Pens are ignored.
+ */
+template <>
+struct CellTraits<char>
+{
+	static constexpr char blank() { return ' '; }
+
+	static char widen(char glyph, Pen /* pen */) { return glyph; }
+
+	/**
+	 * Get the cell for a line drawn with \p glyph and \p pen, which lines
+	 * leave in the directions \p shape (a mask of LineDir).
+	 */
+	static char line(char glyph, std::uint8_t /* shape */, Pen /* pen */) { return glyph; }
+
+	static void fill(char* dst, char glyph, Pen /* pen */, size_t count)
+	{
+		std::memset(dst, glyph, count);
+	}
+
+	static void copy(char* dst, const char* src, Pen /* pen */, size_t count)
+	{
+		std::memcpy(dst, src, count);
+	}
+
+	/**
+	 * Copy \p count glyphs from \p src to \p dst, skipping Transparent ones
+	 * (see masked_blit()), drawing each with the pen in \p pens.
+	 */
+	static void blit(char* dst, const char* src, const Pen* /* pens */, size_t count)
+	{
+		masked_blit(dst, src, count);
+	}
+};
+
+/**
+ * Unicode cells, where lines drawn with the usual ASCII glyphs ("-|.'+") are
+ * replaced by the box drawing characters of the same shape. Pens are ignored.
+ */
+template <>
+struct CellTraits<char32_t>
+{
+	static constexpr char32_t blank() { return U' '; }
+
+	static char32_t widen(char glyph, Pen /* pen */) { return static_cast<unsigned char>(glyph); }
+
+	/**
+	 * Get the box drawing character (light lines) for \p shape.
+	 */
+	static constexpr char32_t box_drawing(std::uint8_t shape)
+	{
+		constexpr char32_t table[16] = {
+			U'─', // none
+			U'│', // up
+			U'─', // right
+			U'└', // up right
+			U'│', // down
+			U'│', // up down
+			U'┌', // right down
+			U'├', // up right down
+			U'─', // left
+			U'┘', // up left
+			U'─', // right left
+			U'┴', // up right left
+			U'┐', // down left
+			U'┤', // up down left
+			U'┬', // right down left
+			U'┼', // all
+		};
+		return table[shape & 15];
+	}
+
+	static char32_t line(char glyph, std::uint8_t shape, Pen pen)
+	{
+		switch(glyph) {
+		case '-':
+		case '|':
+		case '.':
+		case '\'':
+		case '+':
+			return box_drawing(shape);
+		default:
+			return widen(glyph, pen);
+		}
+	}
+
+	static void fill(char32_t* dst, char glyph, Pen /* pen */, size_t count)
+	{
+		std::fill(dst, dst + count, widen(glyph, 0));
+	}
+
+	static void copy(char32_t* dst, const char* src, Pen /* pen */, size_t count)
+	{
+		for(size_t idx = 0; idx < count; ++idx) {
+			dst[idx] = widen(src[idx], 0);
+		}
+	}
+
+	static void blit(char32_t* dst, const char* src, const Pen* /* pens */, size_t count)
+	{
+		for(size_t idx = 0; idx < count; ++idx) {
+			if(src[idx] != '\0') {
+				dst[idx] = widen(src[idx], 0);
+			}
+		}
+	}
+};
+
+/**
+ * A cell of type \p Glyph (char or char32_t) together with the Pen it was
+ * drawn with, packed into 32 bits like a curses chtype: the glyph is in the
+ * low 24 bits, and the pen in the top 8.
+ *
+ * This keeps colourful rows as compact as plain Unicode ones, so they can be
+ * written out in bulk just as quickly.
+ */
+template <typename Glyph>
+struct Styled
+{
+	std::uint32_t bits;
+public:
+	static constexpr Styled make(Glyph glyph, Pen pen)
+	{
+		return { code(glyph) | static_cast<std::uint32_t>(pen) << 24 };
+	}
+
+	Glyph glyph() const { return static_cast<Glyph>(bits & 0xFFFFFF); }
+	Pen pen() const { return static_cast<Pen>(bits >> 24); }
+
+private:
+	static constexpr std::uint32_t code(char glyph) { return static_cast<unsigned char>(glyph); }
+	static constexpr std::uint32_t code(char32_t glyph) { return glyph; }
+};
+
+static_assert(sizeof(Styled<char32_t>) == 4, "cells must be packed into 32 bits");
+
+/**
+ * Cells with a pen, whose glyphs are chosen as for \p Glyph cells.
+ */
+template <typename Glyph>
+struct CellTraits<Styled<Glyph>>
+{
+	using Cell = Styled<Glyph>;
+	using Plain = CellTraits<Glyph>;
+
+	static constexpr Cell blank() { return Cell::make(Plain::blank(), 0); }
+
+	static Cell widen(char glyph, Pen pen)
+	{
+		return Cell::make(Plain::widen(glyph, pen), pen);
+	}
+
+	static Cell line(char glyph, std::uint8_t shape, Pen pen)
+	{
+		return Cell::make(Plain::line(glyph, shape, pen), pen);
+	}
+
+	static void fill(Cell* dst, char glyph, Pen pen, size_t count)
+	{
+		std::fill(dst, dst + count, widen(glyph, pen));
+	}
+
+	static void copy(Cell* dst, const char* src, Pen pen, size_t count)
+	{
+		for(size_t idx = 0; idx < count; ++idx) {
+			dst[idx] = widen(src[idx], pen);
+		}
+	}
+
+	static void blit(Cell* dst, const char* src, const Pen* pens, size_t count)
+	{
+		for(size_t idx = 0; idx < count; ++idx) {
+			if(src[idx] != '\0') {
+				dst[idx] = widen(src[idx], pens ? pens[idx] : 0);
+			}
+		}
+	}
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines CoverageMask, which tracks which cells of a region are
+ * already hidden, so that elements underneath them can be skipped.
+ */
+
+#include "base.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A bitmap of the cells of a rectangular region which are covered, one bit per
+ * cell, so that whole rectangles can be marked and tested 64 cells at a time.
+ *
+ * Cells outside the region are never visible, so count as covered.
+ */
+struct CoverageMask
+{
+	point min = { 0, 0 }; // top left cell of the region
+	int width = 0, height = 0;
+	int words = 0; // per row
+	std::vector<std::uint64_t> bits; // row-major
+public:
+	/**
+	 * Return if a region from \p min to \p max (inclusive) is small enough
+	 * to be tracked, i.e. about the size of a screen, so that the mask
+	 * takes far less memory than what is drawn onto.
+	 */
+	static bool can_track(point min, point max)
+	{
+		constexpr long long limit = 1ll << 20; // cells, so 128 KiB
+		long long w = static_cast<long long>(max.x) - min.x + 1;
+		long long h = static_cast<long long>(max.y) - min.y + 1;
+		return 0 < w && 0 < h && w <= limit && h <= limit / w;
+	}
+
+	/**
+	 * Uncover everything, and change the region to \p lo to \p hi
+	 * (inclusive), which must be trackable (see can_track()).
+	 */
+	void reset(point lo, point hi)
+	{
+		min = lo;
+		width = hi.x - lo.x + 1;
+		height = hi.y - lo.y + 1;
+		words = (width + 63) / 64;
+		bits.assign(static_cast<size_t>(words) * height, 0);
+	}
+
+	/**
+	 * Return if every cell from (\p x1, \p y1) to (\p x2, \p y2) inclusive
+	 * is covered.
+	 */
+	bool covered(int x1, int y1, int x2, int y2) const
+	{
+		int first, last;
+		if(!this->clip(x1, y1, x2, y2, first, last)) {
+			return true;
+		}
+		for(int y = y1; y <= y2; ++y) {
+			const std::uint64_t* row = &bits[static_cast<size_t>(y) * words];
+			for(int word = first / 64; word <= last / 64; ++word) {
+				std::uint64_t want = span(word, first, last);
+				if((row[word] & want) != want) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Mark every cell from (\p x1, \p y1) to (\p x2, \p y2) inclusive as
+	 * covered.
+	 */
+	void cover(int x1, int y1, int x2, int y2)
+	{
+		int first, last;
+		if(!this->clip(x1, y1, x2, y2, first, last)) {
+			return;
+		}
+		for(int y = y1; y <= y2; ++y) {
+			std::uint64_t* row = &bits[static_cast<size_t>(y) * words];
+			for(int word = first / 64; word <= last / 64; ++word) {
+				row[word] |= span(word, first, last);
+			}
+		}
+	}
+
+private:
+	/**
+	 * Clip a rectangle to the region, converting \p y1 and \p y2 to rows,
+	 * and storing the first and last columns in \p first and \p last.
+	 * Returns false if nothing is left.
+	 */
+	bool clip(int x1, int& y1, int x2, int& y2, int& first, int& last) const
+	{
+		// long long, as the rectangle may be anywhere
+		long long left = std::max(0ll, static_cast<long long>(x1) - min.x);
+		long long right = std::min<long long>(width - 1, static_cast<long long>(x2) - min.x);
+		long long top = std::max(0ll, static_cast<long long>(y1) - min.y);
+		long long bottom = std::min<long long>(height - 1, static_cast<long long>(y2) - min.y);
+		if(left > right || top > bottom) {
+			return false;
+		}
+		first = static_cast<int>(left);
+		last = static_cast<int>(right);
+		y1 = static_cast<int>(top);
+		y2 = static_cast<int>(bottom);
+		return true;
+	}
+
+	/**
+	 * Get the bits of \p word which are in the columns \p first to \p last.
+	 */
+	static std::uint64_t span(int word, int first, int last)
+	{
+		int lo = std::max(first - word * 64, 0);
+		int hi = std::min(last - word * 64, 63);
+		std::uint64_t upto = hi == 63 ? ~0ull : (1ull << (hi + 1)) - 1;
+		return upto & ~((1ull << lo) - 1);
+	}
+};
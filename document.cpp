@@ -0,0 +1,450 @@
+#include "document.hpp"
+
+#include "export.hpp"
+#include "sprite.hpp"
+
+#include <algorithm>
+
+/**
+ * Find the element drawing at a spot. The user of this class must set
+ * current_id to the id of the item being currently drawn.
+ */
+struct OwnerFinder
+	: public Canvas
+{
+	int current_id;
+	int target_id;
+	int tx, ty;
+public:
+	OwnerFinder(int x, int y)
+		: current_id(-1), target_id(-1), tx(x), ty(y)
+	{
+		this->set_visible(x, y, x, y);
+	}
+
+	virtual void impl_set(char /* fill */, int x, int y) override
+	{
+		if(x == tx && y == ty) {
+			target_id = current_id;
+		}
+	}
+};
+
+/**
+ * Find if anything is drawn in a region.
+ */
+struct RegionFinder
+	: public Canvas
+{
+	point min, max; // inclusive
+	bool found;
+public:
+	RegionFinder(point min, point max)
+		: min(min), max(max), found(false)
+	{
+		this->set_visible(min.x, min.y, max.x, max.y);
+	}
+
+	virtual void impl_set(char /* fill */, int x, int y) override
+	{
+		if(min.x <= x && x <= max.x && min.y <= y && y <= max.y) {
+			found = true;
+		}
+	}
+};
+
+Document::Document()
+{
+	layers.emplace_back("default");
+}
+
+Document::Document(const Document& other)
+{
+	*this = other;
+}
+
+/**
+ * Replace the elements of \p out with copies of the ones in \p from.
+ */
+static void copy_elements(const ElementStack& from, ElementStack& out)
+{
+	out.elements.clear();
+	for(auto& elem : from.elements) {
+		out.elements.push_back(elem->clone());
+		// the cache depends on the styles of the original
+		if(auto* group = dynamic_cast<ElementStack*>(out.elements.back().get())) {
+			group->invalidate();
+		}
+	}
+	out.offset = from.offset;
+	out.invalidate();
+}
+
+/**
+ * Get the style in \p to which is at the same place as \p style is in \p
+ * from, or null if \p style isn't in \p from.
+ */
+static const Style* same_style(const Style* style, const MultiStyleManager& from, const MultiStyleManager& to)
+{
+	size_t slot = 0, found_slot = 0;
+	std::uint32_t found_id = 0;
+	bool found = false;
+	from.for_each([&] (auto& sm) {
+		for(std::uint32_t id = 0; !found && id < sm.table.size(); ++id) {
+			if(&sm.table.styles[id] == style) {
+				found = true;
+				found_slot = slot;
+				found_id = id;
+			}
+		}
+		++slot;
+	});
+
+	const Style* same = nullptr;
+	slot = 0;
+	to.for_each([&] (auto& sm) {
+		if(found && slot++ == found_slot && found_id < sm.table.size()) {
+			same = &sm.table.styles[found_id];
+		}
+	});
+	return same;
+}
+
+/**
+ * Copy the cached drawing of \p from (using the styles \p from_styles) to \p
+ * out, which has the same elements, using the same styles in \p out_styles.
+ * Nothing is copied if the cache is out of date.
+ */
+static void copy_cache(const ElementStack& from, ElementStack& out,
+	const MultiStyleManager& from_styles, const MultiStyleManager& out_styles)
+{
+	if(!from.is_cache_valid()) {
+		return;
+	}
+
+	std::vector<const Style*> used;
+	for(auto* style : from.cache_styles) {
+		const Style* same = same_style(style, from_styles, out_styles);
+		if(!same) {
+			return;
+		}
+		used.push_back(same);
+	}
+
+	out.cache = from.cache;
+	out.cache_flag = std::make_shared<StaleFlag>();
+	for(auto* style : used) {
+		style->add_dependent(out.cache_flag);
+	}
+	out.cache_styles = std::move(used);
+}
+
+Document& Document::operator=(const Document& other)
+{
+	if(this == &other) {
+		return *this;
+	}
+
+	msm = other.msm;
+	copy_elements(other.es, es);
+	layers.clear();
+	for(auto& layer : other.layers) {
+		layers.emplace_back(layer.name);
+		layers.back().set_flags(layer.flags());
+		copy_elements(layer.stack, layers.back().stack);
+		// so copies don't redraw every layer
+		copy_cache(layer.stack, layers.back().stack, other.msm, msm);
+	}
+	active = other.active;
+	return *this;
+}
+
+void Document::select_layer(size_t layer)
+{
+	if(layer == active) {
+		return;
+	}
+
+	// the old layer is cached from now on
+	layers[active].stack.elements = std::move(es.elements);
+	layers[active].stack.offset = es.offset;
+	layers[active].stack.invalidate();
+
+	active = layer;
+	es.elements = std::move(layers[active].stack.elements);
+	es.offset = layers[active].stack.offset;
+	layers[active].stack.elements.clear();
+	layers[active].stack.offset = { 0, 0 };
+	layers[active].stack.invalidate();
+	es.flatten();
+}
+
+void Document::insert_layer(size_t at, std::string name)
+{
+	layers.emplace(layers.begin() + at, std::move(name));
+	if(at <= active) {
+		++active;
+	}
+}
+
+bool Document::erase_layer(size_t at)
+{
+	if(at >= layers.size() || at == active || layers.size() == 1 || !layers[at].stack.elements.empty()) {
+		return false;
+	}
+	layers.erase(layers.begin() + at);
+	if(at < active) {
+		--active;
+	}
+	return true;
+}
+
+void Document::shift_all(int x, int y)
+{
+	for(size_t idx = 0; idx < layers.size(); ++idx) {
+		if(idx == active) {
+			es.shift_elements(x, y);
+		} else {
+			layers[idx].stack.shift(x, y);
+		}
+	}
+}
+
+int Document::id_at(point pos) const
+{
+	if(!this->active_layer().visible) {
+		return -1; // nothing is drawn there
+	}
+
+	OwnerFinder of(pos.x, pos.y);
+	of.styles = &msm;
+	for(size_t idx = 0; idx < es.elements.size(); ++idx) {
+		// need to manually set id for each element
+		// can't draw es directly
+		of.current_id = idx;
+		of.draw(*es.elements[idx]);
+	}
+	return of.target_id;
+}
+
+/**
+ * Get the rectangle from \p p1 to \p p2 inclusive as its top left \p min and
+ * bottom right \p max.
+ */
+static void normalize(point p1, point p2, point& min, point& max)
+{
+	min = { std::min(p1.x, p2.x), std::min(p1.y, p2.y) };
+	max = { std::max(p1.x, p2.x), std::max(p1.y, p2.y) };
+}
+
+/**
+ * Return if \p elem (drawn with the styles \p msm) draws anything in the
+ * rectangle from \p min to \p max inclusive.
+ */
+static bool draws_in(const Drawable& elem, const MultiStyleManager& msm, point min, point max)
+{
+	RegionFinder finder{min, max};
+	finder.styles = &msm;
+	finder.draw(elem);
+	return finder.found;
+}
+
+
+/**
+ * Return if the rectangles from \p lo to \p hi and from \p min to \p max
+ * (inclusive) overlap.
+ */
+static bool overlaps(point lo, point hi, point min, point max)
+{
+	return lo.x <= max.x && min.x <= hi.x && lo.y <= max.y && min.y <= hi.y;
+}
+
+/**
+ * Return if the rectangle from \p lo to \p hi overlaps the part of the
+ * rectangle from \p from_min to \p from_max which isn't in the rectangle from
+ * \p to_min to \p to_max (all inclusive).
+ */
+static bool reaches_outside(point lo, point hi, point from_min, point from_max, point to_min, point to_max)
+{
+	if(!overlaps(lo, hi, from_min, from_max)) {
+		return false;
+	}
+	lo = { std::max(lo.x, from_min.x), std::max(lo.y, from_min.y) };
+	hi = { std::min(hi.x, from_max.x), std::min(hi.y, from_max.y) };
+	return lo.x < to_min.x || to_max.x < hi.x || lo.y < to_min.y || to_max.y < hi.y;
+}
+
+/**
+ * Add the up to four rectangles which make up the part of the rectangle from
+ * \p a_min to \p a_max which isn't in the rectangle from \p b_min to \p
+ * b_max (all inclusive) to \p out, as pairs of corners.
+ */
+static void subtract(point a_min, point a_max, point b_min, point b_max, std::vector<std::pair<point, point>>& out)
+{
+	int top = std::max(a_min.y, b_min.y), bottom = std::min(a_max.y, b_max.y);
+	if(std::max(a_min.x, b_min.x) > std::min(a_max.x, b_max.x) || top > bottom) {
+		out.emplace_back(a_min, a_max);
+		return;
+	}
+	if(a_min.y < top) {
+		out.emplace_back(a_min, point{ a_max.x, top - 1 });
+	}
+	if(bottom < a_max.y) {
+		out.emplace_back(point{ a_min.x, bottom + 1 }, a_max);
+	}
+	if(a_min.x < b_min.x) {
+		out.emplace_back(point{ a_min.x, top }, point{ b_min.x - 1, bottom });
+	}
+	if(b_max.x < a_max.x) {
+		out.emplace_back(point{ b_max.x + 1, top }, point{ a_max.x, bottom });
+	}
+}
+
+std::vector<int> Document::ids_in_region(point p1, point p2) const
+{
+	point min, max;
+	normalize(p1, p2, min, max);
+
+	RegionFinder probe{min, max}; // for extents only
+	probe.styles = &msm;
+	std::vector<int> ids;
+	for(size_t idx = 0; idx < es.elements.size(); ++idx) {
+		point lo, hi;
+		if(es.elements[idx]->extent(probe, lo, hi) && !overlaps(lo, hi, min, max)) {
+			continue; // can't draw there
+		}
+		if(draws_in(*es.elements[idx], msm, min, max)) {
+			ids.push_back(idx);
+		}
+	}
+	return ids;
+}
+
+void Document::select_region(RegionSelection& region, point p1, point p2) const
+{
+	normalize(p1, p2, region.min, region.max);
+
+	RegionFinder probe{region.min, region.max}; // for extents only
+	probe.styles = &msm;
+	region.index.build(es, probe);
+
+	region.selected.reset(es.elements.size());
+	for(size_t idx = 0; idx < es.elements.size(); ++idx) {
+		auto& extent = region.index.extents[idx];
+		if(extent.known && !overlaps(extent.min, extent.max, region.min, region.max)) {
+			continue; // can't draw there
+		}
+		region.selected.set(idx, draws_in(*es.elements[idx], msm, region.min, region.max));
+	}
+}
+
+void Document::reselect_region(RegionSelection& region, point p1, point p2) const
+{
+	point min, max;
+	normalize(p1, p2, min, max);
+
+	// the elements near the strips added or removed
+	std::vector<std::pair<point, point>> strips;
+	subtract(region.min, region.max, min, max, strips);
+	subtract(min, max, region.min, region.max, strips);
+
+	std::vector<int> near;
+	bool everything = false;
+	for(auto& strip : strips) {
+		if(!region.index.near(strip.first, strip.second, near)) {
+			everything = true;
+			break;
+		}
+	}
+	if(everything) {
+		near.resize(es.elements.size());
+		for(size_t idx = 0; idx < near.size(); ++idx) {
+			near[idx] = idx;
+		}
+	} else {
+		std::sort(near.begin(), near.end());
+		near.erase(std::unique(near.begin(), near.end()), near.end());
+	}
+
+	for(int id : near) {
+		auto& extent = region.index.extents[id];
+		if(extent.known) {
+			// selected elements only change if they drew in the removed
+			// strips, and unselected ones if they draw in the added ones
+			bool changed = region.selected.has(id)
+				? reaches_outside(extent.min, extent.max, region.min, region.max, min, max)
+				: reaches_outside(extent.min, extent.max, min, max, region.min, region.max);
+			if(!changed) {
+				continue;
+			}
+		}
+
+		// unselected elements don't draw in the old rectangle, so
+		// drawing in the new one means drawing in the added strips
+		region.selected.set(id, draws_in(*es.elements[id], msm, min, max));
+	}
+
+	region.min = min;
+	region.max = max;
+}
+
+void Document::draw(Canvas& canvas) const
+{
+	const MultiStyleManager* saved = canvas.styles;
+	canvas.styles = &msm;
+	for(size_t idx = 0; idx < layers.size(); ++idx) {
+		if(layers[idx].visible) {
+			this->elements_of(idx).draw(canvas);
+		}
+	}
+	canvas.styles = saved;
+}
+
+void Document::render(AsciiRenderer& out, point p1, point p2) const
+{
+	out.reset(p1.x, p1.y, p2.x, p2.y);
+	this->draw(out);
+}
+
+bool Document::bounds(point& min, point& max) const
+{
+	BoundsFinder bounds;
+	this->draw(bounds);
+	if(bounds.empty()) {
+		return false;
+	}
+	min = bounds.min;
+	max = bounds.max;
+	return true;
+}
+
+bool Document::render_all(TextSink& sink) const
+{
+	point min, max;
+	return this->bounds(min, max) && export_region(*this, min, max, sink);
+}
+
+/**
+ * Rebuild the caches of \p elem and the groups inside it, using the styles \p
+ * msm.
+ */
+static void prepare_element(const Drawable& elem, const MultiStyleManager& msm)
+{
+	if(auto* group = dynamic_cast<const ElementStack*>(&elem)) {
+		for(auto& inner : group->elements) {
+			prepare_element(*inner, msm);
+		}
+		if(group->use_cache && !group->is_cache_valid()) {
+			group->rebuild_cache(&msm);
+		}
+	}
+}
+
+void Document::prepare() const
+{
+	for(size_t idx = 0; idx < layers.size(); ++idx) {
+		if(layers[idx].visible) {
+			prepare_element(this->elements_of(idx), msm);
+		}
+	}
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines Document, which holds everything in a single diagram.
+ */
+
+#include "asciirender.hpp"
+#include "base.hpp"
+#include "drawable.hpp"
+#include "multistyle.hpp"
+#include "selection.hpp"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct TextSink; // see export.hpp
+
+/**
+ * The state of a DocumentLayer, as bits (as stored in files and Changes).
+ */
+enum LayerFlags : std::uint8_t
+{
+	LayerHidden = 1, ///< Not drawn.
+	LayerLocked = 2, ///< Its elements can't be edited.
+	LayerActive = 4, ///< Being edited (only in files).
+};
+
+/**
+ * A named layer of a document, drawn over the layers below it.
+ *
+ * Layers which aren't being edited keep their elements in \a stack, which is
+ * cached (see ElementStack), so they are drawn from a single raster until one
+ * of their styles is modified. The elements of the active layer are in
+ * Document::es instead.
+ */
+struct DocumentLayer
+{
+	std::string name;
+	bool visible = true;
+	bool locked = false;
+	ElementStack stack; // empty while active
+public:
+	explicit DocumentLayer(std::string name)
+		: name(std::move(name))
+	{
+		stack.use_cache = true;
+	}
+
+	/**
+	 * Get the state as LayerFlags, without LayerActive.
+	 */
+	std::uint8_t flags() const
+	{
+		return (visible ? 0 : LayerHidden) | (locked ? LayerLocked : 0);
+	}
+
+	void set_flags(std::uint8_t flags)
+	{
+		visible = !(flags & LayerHidden);
+		locked = flags & LayerLocked;
+	}
+};
+
+/**
+ * A diagram: its layers of elements, and the styles they refer to.
+ *
+ * Everything needed to draw or query a diagram is in here, so separate
+ * documents are completely independent. Once prepare() has been called after
+ * the last modification, the const methods only read the document, so they can
+ * be called from several threads at once.
+ *
+ * The elements of the active layer are in \a es, so editing (and Changes)
+ * refer to that layer, and only it is redrawn as it is edited: the other
+ * layers are drawn from their cached rasters.
+ */
+struct Document
+{
+	ElementStack es; // of the active layer
+	MultiStyleManager msm;
+	std::vector<DocumentLayer> layers; // bottom first, never empty
+	size_t active = 0;
+public:
+	/**
+	 * Create an empty document, with a single layer.
+	 */
+	Document();
+
+	/**
+	 * Copy all layers and styles of \p other.
+	 */
+	Document(const Document& other);
+
+	Document& operator=(const Document& other);
+
+	Document(Document&&) = default;
+	Document& operator=(Document&&) = default;
+
+	DocumentLayer& active_layer() { return layers[active]; }
+	const DocumentLayer& active_layer() const { return layers[active]; }
+
+	/**
+	 * Get the elements of layer \p layer, wherever they are kept.
+	 */
+	ElementStack& elements_of(size_t layer)
+	{
+		return layer == active ? es : layers[layer].stack;
+	}
+
+	const ElementStack& elements_of(size_t layer) const
+	{
+		return layer == active ? es : layers[layer].stack;
+	}
+
+	/**
+	 * Make \p layer (which must exist) the one being edited, moving its
+	 * elements into es. Its offset is applied to the elements, so
+	 * positions in es are positions in the document.
+	 */
+	void select_layer(size_t layer);
+
+	/**
+	 * Add an empty layer called \p name at index \p at (at most the
+	 * number of layers), below the layer currently there.
+	 */
+	void insert_layer(size_t at, std::string name);
+
+	/**
+	 * Remove the layer at \p at, which must be empty, not active, and not
+	 * the only one. Returns false (doing nothing) otherwise.
+	 */
+	bool erase_layer(size_t at);
+
+	/**
+	 * Move every element of every layer by (\p x, \p y). Layers which
+	 * aren't active only change their offset, so their caches are kept.
+	 */
+	void shift_all(int x, int y);
+
+	/**
+	 * Get the index (in es) of the topmost element of the active layer
+	 * drawing at \p pos, or -1 if there is none (or the layer is hidden).
+	 */
+	int id_at(point pos) const;
+
+	/**
+	 * Get the indices (in order) of all elements of the active layer
+	 * drawing in the rectangle from \p p1 to \p p2 inclusive, which can be
+	 * any two opposite corners.
+	 */
+	std::vector<int> ids_in_region(point p1, point p2) const;
+
+	/**
+	 * Select exactly the elements of the active layer drawing in the
+	 * rectangle from \p p1 to \p p2 inclusive (as ids_in_region()) in \p
+	 * region, indexing them for reselect_region().
+	 */
+	void select_region(RegionSelection& region, point p1, point p2) const;
+
+	/**
+	 * Change \p region (as made by select_region()) to the rectangle from
+	 * \p p1 to \p p2 inclusive. The elements mustn't have changed since.
+	 *
+	 * Only elements whose extent (see Drawable::extent) reaches the strips
+	 * added to or removed from the rectangle are drawn again, and only
+	 * those near the strips are looked at, so moving a corner a little is
+	 * cheap however many elements there are.
+	 */
+	void reselect_region(RegionSelection& region, point p1, point p2) const;
+
+	/**
+	 * Draw the visible layers of the document onto \p canvas, using its
+	 * styles.
+	 */
+	void draw(Canvas& canvas) const;
+
+	/**
+	 * Render the rectangle from \p p1 to \p p2 inclusive into \p out,
+	 * reusing its buffers.
+	 */
+	void render(AsciiRenderer& out, point p1, point p2) const;
+
+	/**
+	 * Get the rectangle (inclusive) which everything is drawn in. Returns
+	 * false if nothing is drawn.
+	 */
+	bool bounds(point& min, point& max) const;
+
+	/**
+	 * Export everything drawn as text into \p sink (see export_region()).
+	 * Returns false (writing nothing) if nothing is drawn, or if writing
+	 * fails.
+	 */
+	bool render_all(TextSink& sink) const;
+
+	/**
+	 * Bring all cached drawings up to date, so drawing doesn't modify
+	 * anything.
+	 */
+	void prepare() const;
+};
@@ -6,12 +6,17 @@
  * container for a set of elements.
  */
 
+#include "base.hpp"
+#include "canvas.hpp"
+#include "coverage.hpp"
+#include "sprite.hpp"
+#include "style.hpp"
+
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <utility>
 
-struct Canvas; // forward declare
-
 /**
  * An interface for objects that can be drawn on a canvas.
  *
@@ -21,7 +26,7 @@ struct Canvas; // forward declare
  *
  * A Drawable should only directly contain information related to the structure
  * of the object; styling should be done with types derived from Style, and the
- * Drawable containing a shared_ptr to one.
+ * Drawable containing a StyleId referring to one.
  */
 struct Drawable
 {
@@ -41,25 +46,156 @@ struct Drawable
 	 * Move the entire object by (\p x, \p y).
 	 */
 	virtual void shift(int x, int y) = 0;
+
+	/**
+	 * Get a rectangle which everything draw() draws onto \p canvas is
+	 * within, from \p min to \p max inclusive. Returns false if this
+	 * isn't known cheaply, in which case the object is never culled.
+	 */
+	virtual bool extent(Canvas& /* canvas */, point& /* min */, point& /* max */) const
+	{
+		return false;
+	}
+
+	/**
+	 * Return if drawing onto \p canvas hides everything underneath within
+	 * the extent(), so that objects below it there needn't be drawn.
+	 */
+	virtual bool opaque(Canvas& /* canvas */) const
+	{
+		return false;
+	}
 };
 
+inline void Canvas::draw(const Drawable& object)
+{
+	pen = 0;
+	object.draw(*this);
+}
+
 /**
  * A container for an ordered sequence of Drawable objects.
  *
  * This is technically an element as well (supporting most features), but is not intended to be used as such.
+ *
+ * The elements are stored relative to \a offset, which is applied lazily when
+ * drawing. This makes moving a group O(1), no matter how many elements it
+ * contains.
+ *
+ * If \a use_cache is set, the drawn elements are kept as a Sprite, which is
+ * only redrawn when a style it uses is modified, or invalidate() is called.
+ * Styles mark the cache stale themselves (see Style::add_dependent), so
+ * checking it is O(1). The styles used are found while drawing, through
+ * Canvas::used_styles.
+ *
+ * Elements which are entirely hidden by opaque elements above them, or are
+ * outside the visible region, are culled (see draw_elements()).
  */
 struct ElementStack
 	: public Drawable
 {
 	std::vector<std::unique_ptr<Drawable>> elements;
+	point offset = { 0, 0 }; // translation applied to all elements
+
+	// Caching should only be used when elements aren't modified directly
+	// (i.e. for groups), since that can't be detected.
+	bool use_cache = false;
+	mutable Sprite cache;
+	mutable std::shared_ptr<StaleFlag> cache_flag; // null if never cached
+	mutable std::vector<const Style*> cache_styles; // used to draw the cache
 public:
 	virtual void draw(Canvas& canvas) const override
 	{
-		for(auto& elem : elements) {
-			elem->draw(canvas);
+		if(use_cache) {
+			if(!this->is_cache_valid()) {
+				this->rebuild_cache(canvas.styles);
+			}
+			if(canvas.used_styles) {
+				// we skip looking up styles, so report them manually
+				canvas.used_styles->insert(canvas.used_styles->end(), cache_styles.begin(), cache_styles.end());
+			}
+			cache.draw(canvas, offset);
+		} else if(offset.x == 0 && offset.y == 0) {
+			this->draw_elements(canvas);
+		} else {
+			OffsetCanvas translated{canvas, offset};
+			this->draw_elements(translated);
 		}
 	}
 
+	/**
+	 * Draw the elements, without applying the offset.
+	 *
+	 * When the visible region of \p canvas is small enough (see
+	 * CoverageMask::can_track()), the elements are first visited from the
+	 * top down, marking the extent of opaque ones in a CoverageMask, and
+	 * any whose extent is already covered are skipped. This doesn't change
+	 * what is drawn: opaque elements overwrite every cell (and line)
+	 * underneath them. It isn't done when collecting the styles used,
+	 * since every one must be seen.
+	 */
+	void draw_elements(Canvas& canvas) const
+	{
+		if(canvas.used_styles || !CoverageMask::can_track(canvas.visible_min, canvas.visible_max)) {
+			for(auto& elem : elements) {
+				canvas.draw(*elem);
+			}
+			return;
+		}
+
+		// reused by every draw on this thread, so nothing is allocated once
+		// they're big enough; the mask is done with before drawing any
+		// groups inside, which add theirs after the ones here
+		thread_local CoverageMask mask;
+		thread_local std::vector<bool> hidden;
+		size_t base = hidden.size();
+
+		// drop the flags added here once done, even if drawing throws
+		struct Restore
+		{
+			size_t base;
+		public:
+			~Restore()
+			{
+				hidden.resize(base);
+			}
+		} restore{base};
+
+		mask.reset(canvas.visible_min, canvas.visible_max);
+		hidden.resize(base + elements.size(), false);
+		for(size_t idx = elements.size(); idx-- > 0;) {
+			point min, max;
+			if(!elements[idx]->extent(canvas, min, max)) {
+				continue;
+			}
+			if(mask.covered(min.x, min.y, max.x, max.y)) {
+				hidden[base + idx] = true;
+			} else if(elements[idx]->opaque(canvas)) {
+				mask.cover(min.x, min.y, max.x, max.y);
+			}
+		}
+
+		for(size_t idx = 0; idx < elements.size(); ++idx) {
+			if(!hidden[base + idx]) {
+				canvas.draw(*elements[idx]);
+			}
+		}
+	}
+
+	/**
+	 * The extent is only known once the elements are cached (from the
+	 * cache), as otherwise finding it is as costly as drawing them.
+	 */
+	virtual bool extent(Canvas& /* canvas */, point& min, point& max) const override
+	{
+		if(!use_cache || !this->is_cache_valid() || cache.width == 0) {
+			return false;
+		}
+		min = { cache.min.x + offset.x, cache.min.y + offset.y };
+		max = { min.x + cache.width - 1, min.y + cache.height - 1 };
+		return true;
+	}
+
 	virtual std::unique_ptr<Drawable> clone() const
 	{
 		std::vector<std::unique_ptr<Drawable>> elements_copy;
@@ -68,14 +204,144 @@ public:
 		}
 		auto copy = std::make_unique<ElementStack>();
 		copy->elements = std::move(elements_copy);
+		copy->offset = offset;
+		copy->use_cache = use_cache;
+		copy->cache = cache;
+		copy->cache_flag = cache_flag; // the copy depends on the same styles
+		copy->cache_styles = cache_styles;
 		return copy;
 	}
 
+	/**
+	 * Discard the cached drawing. This must be called after modifying any
+	 * of the elements.
+	 */
+	void invalidate()
+	{
+		cache_flag.reset();
+	}
+
+	/**
+	 * Return if the cached drawing exists and none of the styles used have
+	 * been modified since.
+	 */
+	bool is_cache_valid() const
+	{
+		return cache_flag && !cache_flag->stale;
+	}
+
+	/**
+	 * Redraw the elements into the cache (without the offset), using the
+	 * styles in \p styles.
+	 */
+	void rebuild_cache(const MultiStyleManager* styles) const
+	{
+		std::vector<const Style*> used;
+
+		BoundsFinder bounds;
+		bounds.styles = styles;
+		bounds.used_styles = &used;
+		this->draw_elements(bounds);
+
+		if(bounds.empty()) {
+			cache = Sprite{};
+		} else {
+			SpriteRenderer renderer{cache, bounds.min.x, bounds.min.y, bounds.max.x, bounds.max.y};
+			renderer.styles = styles;
+			this->draw_elements(renderer);
+		}
+
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+
+		// a new flag, so that the old registrations expire
+		cache_flag = std::make_shared<StaleFlag>();
+		for(auto* style : used) {
+			style->add_dependent(cache_flag);
+		}
+		cache_styles = std::move(used);
+	}
+
+	/**
+	 * Move the stack by (\p x, \p y). This only changes the offset, leaving
+	 * the elements untouched.
+	 */
 	virtual void shift(int x, int y)
+	{
+		offset.x += x;
+		offset.y += y;
+	}
+
+	/**
+	 * Move every element by (\p x, \p y), leaving the offset untouched.
+	 *
+	 * Unlike shift(), this changes the coordinates of the elements
+	 * themselves, which is needed when they are taken out of the stack.
+	 */
+	void shift_elements(int x, int y)
 	{
 		for(auto& elem : elements) {
 			elem->shift(x, y);
 		}
+		this->invalidate();
+	}
+
+	/**
+	 * Apply the offset to the elements directly, resetting it to zero.
+	 */
+	void flatten()
+	{
+		this->shift_elements(offset.x, offset.y);
+		offset = { 0, 0 };
+	}
+
+	/**
+	 * Remove the elements at the indices \p ids (which must be sorted) and
+	 * return them in a new stack. Any stacks removed are unpacked, so the
+	 * new stack doesn't contain any stacks.
+	 */
+	ElementStack extract(const std::vector<int>& ids)
+	{
+		ElementStack group;
+		int offset = 0;
+		for(auto& id : ids) {
+			auto it = elements.begin() + id + offset;
+			if(auto* old_stack = dynamic_cast<ElementStack*>(it->get())) {
+				// unpack the stack
+				old_stack->flatten();
+				for(auto& elem : old_stack->elements) {
+					group.elements.push_back(std::move(elem));
+				}
+			} else {
+				group.elements.push_back(std::move(*it));
+			}
+			elements.erase(it);
+			--offset;
+		}
+		this->invalidate();
+		return group;
+	}
+
+	/**
+	 * Copy the elements at the indices \p ids (which must be sorted) into a
+	 * new stack, unpacking stacks in the same way as extract().
+	 */
+	ElementStack copy_of(const std::vector<int>& ids) const
+	{
+		ElementStack group;
+		for(auto& id : ids) {
+			auto& elem = elements[id];
+			if(auto* old_stack = dynamic_cast<const ElementStack*>(elem.get())) {
+				// unpack the stack
+				for(auto& inner : old_stack->elements) {
+					group.elements.push_back(inner->clone());
+					group.elements.back()->shift(old_stack->offset.x, old_stack->offset.y);
+				}
+			} else {
+				group.elements.push_back(elem->clone());
+			}
+		}
+		return group;
 	}
 
 	/**
@@ -86,6 +352,7 @@ public:
 	{
 		auto elem = std::make_unique<T>(std::forward<Args>(args)...);
 		elements.emplace_back(std::move(elem));
+		this->invalidate();
 	}
 
 	/**
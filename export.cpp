@@ -0,0 +1,111 @@
+#include "export.hpp"
+
+#include "asciirender.hpp"
+#include "sprite.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+/**
+ * Render the rectangle from \p p1 to \p p2 inclusive into \p sink, as
+ * export_region() does, calling \p draw with the canvas of each band of rows,
+ * and the first and last row in it.
+ */
+template <typename Draw>
+static bool export_bands(point p1, point p2, const MultiStyleManager* styles, TextSink& sink, int band_rows, Draw&& draw)
+{
+	point min{ std::min(p1.x, p2.x), std::min(p1.y, p2.y) };
+	point max{ std::max(p1.x, p2.x), std::max(p1.y, p2.y) };
+	band_rows = std::max(band_rows, 1);
+
+	AsciiRenderer band{min.x, min.y, max.x, min.y};
+	band.styles = styles;
+	int blank_lines = 0; // not written yet, in case nothing follows
+
+	// in 64 bits, so the rows past the last band don't overflow near INT_MAX
+	for(std::int64_t next = min.y; next <= max.y; next += band_rows) {
+		int top = static_cast<int>(next);
+		int bottom = static_cast<int>(std::min<std::int64_t>(max.y, next + band_rows - 1));
+		band.reset(min.x, top, max.x, bottom);
+		draw(static_cast<Canvas&>(band), top, bottom);
+
+		for(int row = 0; row < band.height(); ++row) {
+			strview line = band.line(row);
+			size_t length = line.size();
+			while(length > 0 && line[length - 1] == Canvas::Blank) {
+				--length;
+			}
+			if(length == 0) {
+				++blank_lines;
+				continue;
+			}
+
+			for(; blank_lines > 0; --blank_lines) {
+				if(!sink.write("\n")) {
+					return false;
+				}
+			}
+			if(!sink.write(line.substr(0, length)) || !sink.write("\n")) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool export_region(const Document& doc, point p1, point p2, TextSink& sink, int band_rows)
+{
+	int min_y = std::min(p1.y, p2.y), max_y = std::max(p1.y, p2.y);
+
+	// the elements of every visible layer, with the offset of their layer
+	std::vector<std::pair<const ElementStack*, const Drawable*>> elements;
+	for(size_t layer = 0; layer < doc.layers.size(); ++layer) {
+		if(doc.layers[layer].visible) {
+			auto& es = doc.elements_of(layer);
+			for(auto& elem : es.elements) {
+				elements.emplace_back(&es, elem.get());
+			}
+		}
+	}
+	auto draw = [] (Canvas& canvas, const std::pair<const ElementStack*, const Drawable*>& entry) {
+		point offset = entry.first->offset;
+		if(offset.x == 0 && offset.y == 0) {
+			canvas.draw(*entry.second);
+		} else {
+			OffsetCanvas translated{canvas, offset};
+			translated.draw(*entry.second);
+		}
+	};
+
+	// the rows covered by each element, so each band only draws what's in it
+	std::vector<std::pair<int, int>> rows(elements.size(), { 1, 0 }); // empty
+	for(size_t idx = 0; idx < elements.size(); ++idx) {
+		BoundsFinder bounds;
+		bounds.styles = &doc.msm;
+		draw(bounds, elements[idx]);
+		if(!bounds.empty() && bounds.max.y >= min_y && bounds.min.y <= max_y) {
+			rows[idx] = { bounds.min.y, bounds.max.y };
+		}
+	}
+
+	return export_bands(p1, p2, &doc.msm, sink, band_rows, [&] (Canvas& band, int top, int bottom) {
+		for(size_t idx = 0; idx < rows.size(); ++idx) {
+			if(rows[idx].first <= bottom && rows[idx].second >= top) {
+				draw(band, elements[idx]);
+			}
+		}
+	});
+}
+
+bool export_region(const Drawable& drawing, point p1, point p2, TextSink& sink)
+{
+	// the whole drawing is drawn for each band, so use few, large ones
+	std::int64_t width = std::abs(std::int64_t(p2.x) - p1.x) + 1;
+	int band_rows = static_cast<int>(std::max<std::int64_t>(drawing_band_cells / width, 1));
+	return export_bands(p1, p2, nullptr, sink, band_rows, [&drawing] (Canvas& band, int, int) {
+		band.draw(drawing);
+	});
+}
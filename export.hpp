@@ -0,0 +1,85 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines export_region(), which renders a region of a document as
+ * text straight into a TextSink, without holding all of it in memory.
+ */
+
+#include "base.hpp"
+#include "document.hpp"
+#include "drawable.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ * A destination for exported text, which receives it in pieces.
+ */
+struct TextSink
+{
+	virtual ~TextSink() = default;
+
+	/**
+	 * Append \p data, returning false on failure.
+	 */
+	virtual bool write(strview data) = 0;
+};
+
+/**
+ * Collect the text in a string, e.g. for the clipboard, which needs all of it
+ * at once.
+ */
+struct StringSink
+	: public TextSink
+{
+	std::string text;
+public:
+	virtual bool write(strview data) override
+	{
+		text.append(data.data(), data.size());
+		return true;
+	}
+};
+
+/**
+ * Write the text to a file (or pipe), which is not closed afterwards.
+ */
+struct FileSink
+	: public TextSink
+{
+	std::FILE* file;
+public:
+	explicit FileSink(std::FILE* file)
+		: file(file)
+	{
+	}
+
+	virtual bool write(strview data) override
+	{
+		return std::fwrite(data.data(), 1, data.size(), file) == data.size();
+	}
+};
+
+/**
+ * Render the rectangle from \p p1 to \p p2 inclusive of \p doc as text into
+ * \p sink, one line per row, without trailing blanks or blank lines.
+ *
+ * Rows are rendered in bands of \p band_rows, so only one band is held in
+ * memory at once (plus the vertical extent of each element). Returns false if
+ * writing to \p sink fails.
+ */
+bool export_region(const Document& doc, point p1, point p2, TextSink& sink, int band_rows = 64);
+
+/// The most cells held at once when exporting a Drawable (unless a single row
+/// has more).
+constexpr std::int64_t drawing_band_cells = 1 << 24;
+
+/**
+ * Render the rectangle from \p p1 to \p p2 inclusive of \p drawing into \p
+ * sink, as above, for drawings which aren't a Document (e.g. a
+ * MappedDocument). The whole drawing is drawn for each band, so the bands are
+ * as large as drawing_band_cells allows.
+ */
+bool export_region(const Drawable& drawing, point p1, point p2, TextSink& sink);
@@ -0,0 +1,689 @@
+#include "fileformat.hpp"
+
+#include "item/box.hpp"
+#include "item/text.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Round \p size up to a multiple of \p align.
+ */
+static std::uint64_t align_to(std::uint64_t size, std::uint64_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+/**
+ * Return if the \p count items of \p item_size starting at \p offset are
+ * within \p total bytes, without overflowing.
+ */
+static bool in_bounds(std::uint64_t offset, std::uint64_t count, std::uint64_t item_size, std::uint64_t total)
+{
+	return offset <= total && count <= (total - offset) / item_size;
+}
+
+bool DocumentView::open(strview data)
+{
+	bytes = data;
+	if(bytes.size() < sizeof(FileHeader) || reinterpret_cast<std::uintptr_t>(bytes.data()) % 8 != 0) {
+		return false;
+	}
+
+	auto& head = this->header();
+	if(std::memcmp(head.magic, file_magic, sizeof(file_magic)) != 0
+		|| head.version != file_version
+		|| head.byte_order != file_byte_order) {
+		return false;
+	}
+
+	// records are accessed in place, so they need to be aligned
+	if(head.records_offset % alignof(FileRecord) != 0 || head.points_offset % alignof(FilePoint) != 0) {
+		return false;
+	}
+
+	if(!in_bounds(head.records_offset, head.record_count, sizeof(FileRecord), bytes.size())
+		|| !in_bounds(head.points_offset, head.point_count, sizeof(FilePoint), bytes.size())
+		|| !in_bounds(head.text_offset, head.text_size, 1, bytes.size())
+		|| head.styles_offset > bytes.size()) {
+		return false;
+	}
+
+	// there must be a root group
+	return head.record_count > 0 && this->record(0).kind == RecordKind::Group;
+}
+
+std::pair<DocumentView::PointIter, DocumentView::PointIter> DocumentView::points(const FileRecord& rec) const
+{
+	auto& head = this->header();
+	auto base = reinterpret_cast<const FilePoint*>(bytes.data() + head.points_offset);
+	if(rec.offset > head.point_count || rec.count > head.point_count - rec.offset) {
+		return { PointIter{ base }, PointIter{ base } };
+	}
+	return { PointIter{ base + rec.offset }, PointIter{ base + rec.offset + rec.count } };
+}
+
+strview DocumentView::text(const FileRecord& rec) const
+{
+	auto& head = this->header();
+	if(rec.offset > head.text_size || rec.count > head.text_size - rec.offset) {
+		return {};
+	}
+	return { bytes.data() + head.text_offset + rec.offset, rec.count };
+}
+
+void DocumentView::load_styles(MultiStyleManager& msm) const
+{
+	const std::uint32_t max_styles = 1 << 20; // of each type
+	auto& head = this->header();
+	std::uint64_t pos = head.styles_offset;
+	std::uint32_t slot = 0;
+
+	msm.for_each([&] (auto& sm) {
+		using T = typename std::decay_t<decltype(sm)>::style_type;
+		sm = std::decay_t<decltype(sm)>();
+
+		if(slot++ >= head.style_type_count || !in_bounds(pos, 1, sizeof(FileStyleHeader), bytes.size())) {
+			return; // not in the file, so keep the default
+		}
+
+		FileStyleHeader sh;
+		std::memcpy(&sh, bytes.data() + pos, sizeof(sh));
+		pos += sizeof(sh);
+
+		// each style takes at least a byte, so the styles fit in the file,
+		// but limit them further, as each takes far more memory once loaded
+		std::uint64_t parts_size = std::uint64_t(sh.count) * sh.part_count;
+		std::uint64_t order_offset = align_to(pos + parts_size, 4);
+		std::uint64_t end = align_to(order_offset + std::uint64_t(sh.order_count) * 4, 8);
+		if(sh.count == 0 || sh.count > max_styles || sh.part_count == 0 || end > bytes.size()) {
+			pos = bytes.size();
+			return;
+		}
+
+		// replace the default style, keeping ids the same as in the file
+		sm.table = StyleTable<T>();
+		sm.styles.clear();
+		for(std::uint32_t idx = 0; idx < sh.count; ++idx) {
+			const char* parts = bytes.data() + pos + std::uint64_t(idx) * sh.part_count;
+			T style;
+			for(size_t part = 0; part < style_parts<T>.size() && part < sh.part_count; ++part) {
+				style.*style_parts<T>[part].member = parts[part];
+			}
+			sm.table.add(style);
+		}
+
+		for(std::uint32_t idx = 0; idx < sh.order_count; ++idx) {
+			std::uint32_t id;
+			std::memcpy(&id, bytes.data() + order_offset + idx * 4, sizeof(id));
+			if(id < sh.count) {
+				sm.styles.push_back(StyleId<T>{ id });
+			}
+		}
+		if(sm.styles.empty()) {
+			sm.styles.push_back(StyleId<T>{ 0 });
+		}
+
+		pos = end;
+	});
+}
+
+/**
+ * Get the id of \p id in \p msm, or the first style if it doesn't exist.
+ */
+template <typename T>
+static StyleId<T> checked_style(const MultiStyleManager& msm, std::uint32_t id)
+{
+	if(id < msm.get<T>().table.size()) {
+		return StyleId<T>{ id };
+	}
+	return StyleId<T>{ 0 };
+}
+
+std::unique_ptr<MappedDocument> MappedDocument::open(const std::string& path)
+{
+	auto doc = std::make_unique<MappedDocument>();
+	doc->mapping = FileMapping::open(path);
+	if(!doc->mapping || !doc->view.open(doc->mapping->contents())) {
+		return nullptr;
+	}
+
+	auto styles = std::make_shared<MultiStyleManager>();
+	doc->view.load_styles(*styles);
+	doc->styles = std::move(styles);
+	return doc;
+}
+
+void MappedDocument::draw(Canvas& canvas) const
+{
+	auto saved = canvas.styles;
+	canvas.styles = styles.get();
+
+	if(offset.x == 0 && offset.y == 0) {
+		this->draw_record(canvas, 0, 0);
+	} else {
+		OffsetCanvas translated{canvas, offset};
+		this->draw_record(translated, 0, 0);
+	}
+
+	canvas.styles = saved;
+}
+
+/**
+ * Draw record \p idx, which is in \p depth groups.
+ */
+void MappedDocument::draw_record(Canvas& canvas, size_t idx, size_t depth) const
+{
+	const FileRecord& rec = view.record(idx);
+
+	canvas.pen = 0; // until a style is looked up
+	switch(rec.kind) {
+	case RecordKind::Group:
+		if(depth >= DocumentView::max_depth) {
+			break; // too deeply nested to draw without running out of stack
+		}
+		if(rec.x1 == 0 && rec.y1 == 0) {
+			this->draw_children(canvas, idx, depth + 1);
+		} else {
+			OffsetCanvas translated{canvas, point(rec.x1, rec.y1)};
+			this->draw_children(translated, idx, depth + 1);
+		}
+		break;
+	case RecordKind::Box:
+		{
+			Box box{rec.x1, rec.y1, rec.x2, rec.y2, checked_style<BoxStyle>(*styles, rec.style)};
+			box.draw(canvas);
+		} break;
+	case RecordKind::Arrow:
+		{
+			auto points = view.points(rec);
+			auto& st = canvas.style(checked_style<ArrowStyle>(*styles, rec.style));
+			Arrow::draw_path(canvas, st, point(rec.x1, rec.y1), points.first, points.second);
+		} break;
+	case RecordKind::Text:
+		Text::draw_text(canvas, view.text(rec), rec.x1, rec.y1);
+		break;
+	case RecordKind::Layer:
+		break; // see draw_children()
+	}
+}
+
+/**
+ * Draw the children of group record \p group, which are in \p depth groups,
+ * with the offset of the layer each is in, skipping those in hidden layers.
+ */
+void MappedDocument::draw_children(Canvas& canvas, size_t group, size_t depth) const
+{
+	const FileRecord* layer = nullptr; // the last layer record
+	view.for_each_child(group, [&] (size_t child) {
+		const FileRecord& rec = view.record(child);
+		if(rec.kind == RecordKind::Layer) {
+			layer = &rec;
+		} else if(!layer || (layer->x1 == 0 && layer->y1 == 0)) {
+			if(!layer || !(layer->flags & LayerHidden)) {
+				this->draw_record(canvas, child, depth);
+			}
+		} else if(!(layer->flags & LayerHidden)) {
+			OffsetCanvas translated{canvas, point(layer->x1, layer->y1)};
+			this->draw_record(translated, child, depth);
+		}
+	});
+}
+
+/**
+ * Writes a document. Elements of unknown types are skipped.
+ */
+struct DocumentWriter
+{
+	std::FILE* file;     // written to if not null
+	std::string* buffer; // otherwise, appended to this
+	std::uint64_t written = 0;
+
+	std::uint64_t next_point = 0;
+	std::uint64_t next_text = 0;
+public:
+	void write(const void* data, size_t size)
+	{
+		if(file) {
+			std::fwrite(data, 1, size, file);
+		} else {
+			buffer->append(static_cast<const char*>(data), size);
+		}
+		written += size;
+	}
+
+	void pad_to(std::uint64_t align)
+	{
+		static const char zeros[8] = {};
+		this->write(zeros, align_to(written, align) - written);
+	}
+
+	/**
+	 * Return if \p elem can be saved.
+	 */
+	static bool saveable(const Drawable& elem)
+	{
+		return dynamic_cast<const ElementStack*>(&elem)
+			|| dynamic_cast<const Box*>(&elem)
+			|| dynamic_cast<const Arrow*>(&elem)
+			|| dynamic_cast<const Text*>(&elem);
+	}
+
+	/**
+	 * Count the records needed for the elements of \p es (not including
+	 * \p es itself).
+	 */
+	static std::uint64_t count_records(const ElementStack& es)
+	{
+		std::uint64_t count = 0;
+		for(auto& elem : es.elements) {
+			if(auto* group = dynamic_cast<const ElementStack*>(elem.get())) {
+				count += 1 + count_records(*group);
+			} else if(saveable(*elem)) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	/**
+	 * Count the direct children of \p es which are saved.
+	 */
+	static std::uint32_t count_children(const ElementStack& es)
+	{
+		std::uint32_t count = 0;
+		for(auto& elem : es.elements) {
+			if(saveable(*elem)) {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	/**
+	 * Count the points and text needed for the elements of \p es.
+	 */
+	static void count_data(const ElementStack& es, std::uint64_t& points, std::uint64_t& text)
+	{
+		for(auto& elem : es.elements) {
+			if(auto* group = dynamic_cast<const ElementStack*>(elem.get())) {
+				count_data(*group, points, text);
+			} else if(auto* arrow = dynamic_cast<const Arrow*>(elem.get())) {
+				points += arrow->points.size();
+			} else if(auto* txt = dynamic_cast<const Text*>(elem.get())) {
+				text += txt->content().size();
+			}
+		}
+	}
+
+	template <typename T>
+	void write_styles(const StyleManager<T>& sm)
+	{
+		FileStyleHeader sh{};
+		sh.count = sm.table.size();
+		sh.part_count = style_parts<T>.size();
+		sh.order_count = sm.styles.size();
+		this->write(&sh, sizeof(sh));
+
+		for(auto& style : sm.table.styles) {
+			for(auto& part : style_parts<T>) {
+				this->write(&(style.*part.member), 1);
+			}
+		}
+		this->pad_to(4);
+
+		for(auto& id : sm.styles) {
+			this->write(&id.value, sizeof(id.value));
+		}
+		this->pad_to(8);
+	}
+
+	void write_group(const ElementStack& es)
+	{
+		FileRecord rec{};
+		rec.kind = RecordKind::Group;
+		rec.flags = es.use_cache ? 1 : 0;
+		rec.x1 = es.offset.x;
+		rec.y1 = es.offset.y;
+		rec.offset = count_records(es);
+		rec.count = count_children(es);
+		this->write(&rec, sizeof(rec));
+
+		for(auto& elem : es.elements) {
+			this->write_record(*elem);
+		}
+	}
+
+	void write_record(const Drawable& elem)
+	{
+		FileRecord rec{};
+
+		if(auto* group = dynamic_cast<const ElementStack*>(&elem)) {
+			this->write_group(*group);
+			return;
+		} else if(auto* box = dynamic_cast<const Box*>(&elem)) {
+			rec.kind = RecordKind::Box;
+			rec.style = box->style.value;
+			rec.x1 = box->x1;
+			rec.y1 = box->y1;
+			rec.x2 = box->x2;
+			rec.y2 = box->y2;
+			rec.key = box->key;
+		} else if(auto* arrow = dynamic_cast<const Arrow*>(&elem)) {
+			rec.kind = RecordKind::Arrow;
+			rec.style = arrow->style.value;
+			rec.x1 = arrow->start.x;
+			rec.y1 = arrow->start.y;
+			rec.x2 = static_cast<std::int32_t>(arrow->start_box);
+			rec.y2 = static_cast<std::int32_t>(arrow->end_box);
+			rec.offset = next_point;
+			rec.count = arrow->points.size();
+			next_point += rec.count;
+		} else if(auto* txt = dynamic_cast<const Text*>(&elem)) {
+			rec.kind = RecordKind::Text;
+			rec.x1 = txt->x;
+			rec.y1 = txt->y;
+			rec.offset = next_text;
+			rec.count = txt->content().size();
+			next_text += rec.count;
+		} else {
+			return;
+		}
+
+		this->write(&rec, sizeof(rec));
+	}
+
+	void write_points(const ElementStack& es)
+	{
+		for(auto& elem : es.elements) {
+			if(auto* group = dynamic_cast<const ElementStack*>(elem.get())) {
+				this->write_points(*group);
+			} else if(auto* arrow = dynamic_cast<const Arrow*>(elem.get())) {
+				for(auto& segment : arrow->points) {
+					FilePoint fp{ segment.first.x, segment.first.y, static_cast<std::uint32_t>(segment.second) };
+					this->write(&fp, sizeof(fp));
+				}
+			}
+		}
+	}
+
+	void write_text(const ElementStack& es)
+	{
+		for(auto& elem : es.elements) {
+			if(auto* group = dynamic_cast<const ElementStack*>(elem.get())) {
+				this->write_text(*group);
+			} else if(auto* txt = dynamic_cast<const Text*>(elem.get())) {
+				txt->content().for_each_piece(0, [&] (strview piece) {
+					this->write(piece.data(), piece.size());
+					return true;
+				});
+			}
+		}
+	}
+
+	/**
+	 * Write the root group of \p doc, with a layer record before the
+	 * elements of each layer.
+	 */
+	void write_layers(const Document& doc)
+	{
+		FileRecord root{};
+		root.kind = RecordKind::Group;
+		for(size_t idx = 0; idx < doc.layers.size(); ++idx) {
+			root.offset += 1 + count_records(doc.elements_of(idx));
+			root.count += 1 + count_children(doc.elements_of(idx));
+		}
+		this->write(&root, sizeof(root));
+
+		for(size_t idx = 0; idx < doc.layers.size(); ++idx) {
+			const DocumentLayer& layer = doc.layers[idx];
+			const ElementStack& es = doc.elements_of(idx);
+
+			FileRecord rec{};
+			rec.kind = RecordKind::Layer;
+			rec.flags = layer.flags() | (idx == doc.active ? LayerActive : 0);
+			rec.x1 = es.offset.x;
+			rec.y1 = es.offset.y;
+			rec.offset = next_text;
+			rec.count = layer.name.size();
+			next_text += rec.count;
+			this->write(&rec, sizeof(rec));
+
+			for(auto& elem : es.elements) {
+				this->write_record(*elem);
+			}
+		}
+	}
+
+	/**
+	 * Write everything after the header, filling in \p head. The root
+	 * group is either \p es, or the layers of \p doc if it is not null,
+	 * in which case its styles are also written.
+	 */
+	void write_body(FileHeader& head, const ElementStack& es, const Document* doc)
+	{
+		const MultiStyleManager* msm = doc ? &doc->msm : nullptr;
+
+		std::memcpy(head.magic, file_magic, sizeof(file_magic));
+		head.version = file_version;
+		head.byte_order = file_byte_order;
+
+		head.styles_offset = written;
+		if(msm) {
+			head.style_type_count = StyleTypes::size;
+			msm->for_each([&] (auto& sm) { this->write_styles(sm); });
+		}
+
+		head.records_offset = written;
+		if(doc) {
+			head.record_count = 1;
+			for(size_t idx = 0; idx < doc->layers.size(); ++idx) {
+				head.record_count += 1 + count_records(doc->elements_of(idx));
+			}
+			this->write_layers(*doc);
+		} else {
+			head.record_count = 1 + count_records(es);
+			this->write_group(es);
+		}
+
+		head.points_offset = written;
+		if(doc) {
+			for(size_t idx = 0; idx < doc->layers.size(); ++idx) {
+				head.text_size += doc->layers[idx].name.size();
+				count_data(doc->elements_of(idx), head.point_count, head.text_size);
+				this->write_points(doc->elements_of(idx));
+			}
+		} else {
+			count_data(es, head.point_count, head.text_size);
+			this->write_points(es);
+		}
+		this->pad_to(8);
+
+		// in the same order as the records
+		head.text_offset = written;
+		if(doc) {
+			for(size_t idx = 0; idx < doc->layers.size(); ++idx) {
+				this->write(doc->layers[idx].name.data(), doc->layers[idx].name.size());
+				this->write_text(doc->elements_of(idx));
+			}
+		} else {
+			this->write_text(es);
+		}
+	}
+};
+
+bool save_document(const std::string& path, const Document& doc, std::uint32_t sequence)
+{
+	std::string tmp_path = path + ".tmp";
+	std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+	if(!file) {
+		return false;
+	}
+
+	DocumentWriter writer{file, nullptr};
+
+	// the header is written at the end, once the offsets are known
+	FileHeader head{};
+	writer.write(&head, sizeof(head));
+	writer.write_body(head, doc.es, &doc);
+	head.sequence = sequence;
+
+	// on disk before replacing the old contents, and the replacement on
+	// disk before returning, since the journal may be cleared next
+	bool ok = std::fseek(file, 0, SEEK_SET) == 0;
+	ok = ok && std::fwrite(&head, sizeof(head), 1, file) == 1;
+	ok = !std::ferror(file) && ok;
+	ok = ok && sync_file(file);
+	ok = std::fclose(file) == 0 && ok;
+
+	if(!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+		std::remove(tmp_path.c_str());
+		return false;
+	}
+	return sync_directory_of(path);
+}
+
+static void load_group(const DocumentView& view, size_t group, ElementStack& out,
+	const MultiStyleManager& msm, const std::shared_ptr<const void>& owner, size_t depth);
+
+/**
+ * Create the element of record \p idx in \p view, which is in \p depth
+ * groups, adding it to \p out. Layer records are skipped, as are the
+ * contents of groups nested more than DocumentView::max_depth deep.
+ */
+static void load_record(const DocumentView& view, size_t idx, ElementStack& out,
+	const MultiStyleManager& msm, const std::shared_ptr<const void>& owner, size_t depth)
+{
+	const FileRecord& rec = view.record(idx);
+
+	switch(rec.kind) {
+	case RecordKind::Group:
+		{
+			auto child = std::make_unique<ElementStack>();
+			child->offset = { rec.x1, rec.y1 };
+			child->use_cache = rec.flags & 1;
+			if(depth < DocumentView::max_depth) {
+				load_group(view, idx, *child, msm, owner, depth + 1);
+			}
+			out.elements.push_back(std::move(child));
+		} break;
+	case RecordKind::Box:
+		out.add<Box>(rec.x1, rec.y1, rec.x2, rec.y2, checked_style<BoxStyle>(msm, rec.style));
+		out.back_as<Box>()->key = rec.key;
+		break;
+	case RecordKind::Arrow:
+		{
+			out.add<Arrow>(rec.x1, rec.y1, checked_style<ArrowStyle>(msm, rec.style));
+			auto& arrow = *out.back_as<Arrow>();
+			arrow.start_box = static_cast<std::uint32_t>(rec.x2);
+			arrow.end_box = static_cast<std::uint32_t>(rec.y2);
+			auto points = view.points(rec);
+			arrow.points.assign(points.first, points.second);
+		} break;
+	case RecordKind::Text:
+		out.add<Text>(rec.x1, rec.y1);
+		out.back_as<Text>()->borrow(view.text(rec), owner);
+		break;
+	case RecordKind::Layer:
+		break;
+	}
+}
+
+/**
+ * Create the elements of group record \p group in \p view, which are in \p
+ * depth groups, adding them to \p out.
+ */
+static void load_group(const DocumentView& view, size_t group, ElementStack& out,
+	const MultiStyleManager& msm, const std::shared_ptr<const void>& owner, size_t depth)
+{
+	view.for_each_child(group, [&] (size_t idx) {
+		load_record(view, idx, out, msm, owner, depth);
+	});
+}
+
+bool load_document(const std::string& path, Document& doc, std::uint32_t* sequence)
+{
+	auto mapping = FileMapping::open(path);
+	return mapping && load_document(mapping->contents(), mapping, doc, sequence);
+}
+
+bool load_document(strview data, std::shared_ptr<const void> owner, Document& doc, std::uint32_t* sequence)
+{
+	DocumentView view;
+	if(!view.open(data)) {
+		return false;
+	}
+
+	Document loaded;
+	view.load_styles(loaded.msm);
+
+	// elements before the first layer record (all of them, in documents
+	// without layers) are in the first layer
+	const FileRecord& root = view.record(0);
+	size_t active = 0;
+	bool started = false; // by a layer record
+	view.for_each_child(0, [&] (size_t idx) {
+		const FileRecord& rec = view.record(idx);
+		if(rec.kind == RecordKind::Layer) {
+			if(started || !loaded.layers.back().stack.elements.empty()) {
+				loaded.layers.emplace_back("");
+			}
+			DocumentLayer& layer = loaded.layers.back();
+			layer.name = view.text(rec).str();
+			layer.set_flags(rec.flags);
+			layer.stack.offset = { root.x1 + rec.x1, root.y1 + rec.y1 };
+			if(rec.flags & LayerActive) {
+				active = loaded.layers.size() - 1;
+			}
+			started = true;
+			return;
+		}
+		if(!started) {
+			loaded.layers.back().stack.offset = { root.x1, root.y1 };
+		}
+		load_record(view, idx, loaded.layers.back().stack, loaded.msm, owner, 1);
+	});
+
+	// everything was loaded into the layers, so make the first one active
+	// (as it is in a new document) before switching to the saved one
+	std::swap(loaded.es.elements, loaded.layers.front().stack.elements);
+	std::swap(loaded.es.offset, loaded.layers.front().stack.offset);
+	loaded.es.flatten();
+	loaded.select_layer(active);
+
+	if(sequence) {
+		*sequence = view.header().sequence;
+	}
+
+	doc = std::move(loaded);
+	doc.es.invalidate();
+	return true;
+}
+
+std::string encode_elements(const ElementStack& es)
+{
+	std::string out;
+	DocumentWriter writer{nullptr, &out};
+
+	FileHeader head{};
+	writer.write(&head, sizeof(head));
+	writer.write_body(head, es, nullptr);
+
+	std::memcpy(&out[0], &head, sizeof(head));
+	return out;
+}
+
+bool decode_elements(strview data, std::shared_ptr<const void> owner, ElementStack& out, const MultiStyleManager& msm)
+{
+	DocumentView view;
+	if(!view.open(data)) {
+		return false;
+	}
+
+	const FileRecord& root = view.record(0);
+	out.offset = { root.x1, root.y1 };
+	load_group(view, 0, out, msm, owner, 1);
+	out.invalidate();
+	return true;
+}
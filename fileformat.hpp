@@ -0,0 +1,279 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines the binary document format, as well as functions to save
+ * and load documents.
+ *
+ * The format is designed to be used directly from a memory-mapped file: all
+ * sections are arrays of fixed-size records, so elements can be found and
+ * drawn without parsing or allocating anything (see DocumentView).
+ *
+ * Layout (all integers are native-endian, which is checked on load):
+ * - FileHeader
+ * - Styles: for each style slot (see StyleTypes), a FileStyleHeader, the
+ *   parts of each style (one char each, in the order of T::parts()), then
+ *   the display order as uint32_t ids. Each slot is padded to 8 bytes.
+ * - Records: the root group, followed by all elements in pre-order. A group
+ *   is followed by its elements. In a document, the root group's children
+ *   are split into layers: each Layer record is followed by the elements of
+ *   that layer, up to the next one.
+ * - Points: the points of all arrows.
+ * - Text: the content of all text, referenced by the records.
+ */
+
+#include "base.hpp"
+#include "document.hpp"
+#include "drawable.hpp"
+#include "mapping.hpp"
+#include "multistyle.hpp"
+
+#include "item/arrow.hpp"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+
+constexpr char file_magic[8] = { 'a', 's', 'c', 'i', 'i', 'g', 'r', 'm' };
+constexpr std::uint32_t file_version = 1;
+constexpr std::uint32_t file_byte_order = 0x01020304;
+
+struct FileHeader
+{
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint32_t style_type_count;
+	std::uint32_t sequence; // last journal record included (see journal.hpp)
+
+	std::uint64_t styles_offset;
+	std::uint64_t records_offset, record_count;
+	std::uint64_t points_offset, point_count;
+	std::uint64_t text_offset, text_size;
+};
+
+struct FileStyleHeader
+{
+	std::uint32_t count;
+	std::uint32_t part_count;
+	std::uint32_t order_count;
+	std::uint32_t reserved;
+};
+
+/**
+ * The type of element a FileRecord stores.
+ */
+enum class RecordKind : std::uint8_t
+{
+	Group,
+	Box,
+	Arrow,
+	Text,
+	Layer,
+};
+
+/**
+ * A single element. How the fields are used depends on the kind.
+ */
+struct FileRecord
+{
+	RecordKind kind;
+	std::uint8_t flags;          // Group: 1 if cached, Layer: LayerFlags
+	std::uint16_t reserved;
+	std::uint32_t style;         // Box, Arrow: style id
+	std::int32_t x1, y1, x2, y2; // Box: corners, Arrow: start (x1, y1) and the keys of the boxes anchored to (x2, y2), Text: position, Group, Layer: offset
+	std::uint64_t offset;        // Arrow: first point, Text, Layer: start in text section, Group: records inside (recursively)
+	std::uint32_t count;         // Arrow: number of points, Text: length (of the name for Layer), Group: direct children
+	std::uint32_t key;           // Box: key (see anchor.hpp)
+};
+
+struct FilePoint
+{
+	std::int32_t x, y;
+	std::uint32_t direction; // Arrow::Direction
+};
+
+static_assert(sizeof(FileHeader) == 80, "FileHeader must not have padding");
+static_assert(sizeof(FileRecord) == 40, "FileRecord must not have padding");
+static_assert(sizeof(FilePoint) == 12, "FilePoint must not have padding");
+
+/**
+ * Read-only access to a document in the binary format, without copying.
+ *
+ * Accessors are bounds-checked against the data, so a damaged file results
+ * in missing elements rather than undefined behaviour.
+ */
+struct DocumentView
+{
+	/// The most groups which can be nested in each other, including the root.
+	/// Groups nested any deeper are left empty.
+	static constexpr size_t max_depth = 256;
+
+	strview bytes;
+public:
+	/**
+	 * Iterates over the points of an arrow, giving the same type as the
+	 * elements of Arrow::points.
+	 */
+	struct PointIter
+	{
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = std::pair<point, Arrow::Direction>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = value_type;
+
+		const FilePoint* ptr;
+	public:
+		value_type operator*() const
+		{
+			auto dir = ptr->direction == Arrow::Horizontal ? Arrow::Horizontal : Arrow::Vertical;
+			return { point(ptr->x, ptr->y), dir };
+		}
+
+		PointIter& operator++() { ++ptr; return *this; }
+		bool operator==(const PointIter& other) const { return ptr == other.ptr; }
+		bool operator!=(const PointIter& other) const { return ptr != other.ptr; }
+	};
+public:
+	/**
+	 * Use \p data as the document. Returns false if it isn't a valid
+	 * document, in which case the view must not be used.
+	 */
+	bool open(strview data);
+
+	const FileHeader& header() const
+	{
+		return *reinterpret_cast<const FileHeader*>(bytes.data());
+	}
+
+	size_t record_count() const
+	{
+		return header().record_count;
+	}
+
+	const FileRecord& record(size_t idx) const
+	{
+		auto base = bytes.data() + header().records_offset;
+		return reinterpret_cast<const FileRecord*>(base)[idx];
+	}
+
+	/**
+	 * Get the points of arrow record \p rec.
+	 */
+	std::pair<PointIter, PointIter> points(const FileRecord& rec) const;
+
+	/**
+	 * Get the content of text record \p rec, or the name of layer record
+	 * \p rec.
+	 */
+	strview text(const FileRecord& rec) const;
+
+	/**
+	 * Call \p fn with the index of every direct child of the group at
+	 * record \p group. Groups which overlap the end of the group they're
+	 * in (or of the document) are cut short, so that the groups always nest.
+	 */
+	template <typename Fn>
+	void for_each_child(size_t group, Fn&& fn) const
+	{
+		size_t end = group + 1 + std::min<std::uint64_t>(this->record(group).offset, this->record_count() - group - 1);
+		for(size_t idx = group + 1; idx < end; ) {
+			fn(idx);
+			const FileRecord& rec = this->record(idx);
+			idx += 1 + (rec.kind == RecordKind::Group ? std::min<std::uint64_t>(rec.offset, end - idx - 1) : 0);
+		}
+	}
+
+	/**
+	 * Replace the styles in \p msm with the ones in the document. Style ids
+	 * are kept the same.
+	 */
+	void load_styles(MultiStyleManager& msm) const;
+};
+
+/**
+ * Draws a document directly from a file, without loading it.
+ *
+ * This is useful for displaying or exporting a document that isn't modified.
+ * Only the styles are copied out of the file, so this is fast to open and
+ * takes little memory even for large documents.
+ */
+struct MappedDocument
+	: public Drawable
+{
+	std::shared_ptr<const FileMapping> mapping;
+	DocumentView view;
+	std::shared_ptr<const MultiStyleManager> styles;
+	point offset = { 0, 0 };
+public:
+	/**
+	 * Open the document at \p path, returning null if it can't be read or
+	 * isn't a valid document.
+	 */
+	static std::unique_ptr<MappedDocument> open(const std::string& path);
+
+	virtual std::unique_ptr<Drawable> clone() const override
+	{
+		return std::make_unique<MappedDocument>(*this);
+	}
+
+	/**
+	 * Draw the document, without its hidden layers. This uses the styles
+	 * from the file, regardless of the styles set in \p canvas.
+	 */
+	virtual void draw(Canvas& canvas) const override;
+
+	virtual void shift(int x, int y) override
+	{
+		offset.x += x;
+		offset.y += y;
+	}
+
+private:
+	void draw_record(Canvas& canvas, size_t idx, size_t depth) const;
+	void draw_children(Canvas& canvas, size_t group, size_t depth) const;
+};
+
+/**
+ * Save the layers and styles of \p doc to \p path, as well as the \p
+ * sequence of the last journal record included.
+ *
+ * The file is written to a temporary file first, which then replaces \p path,
+ * so the old contents are still valid if they are memory-mapped. Returns if
+ * saved successfully.
+ */
+bool save_document(const std::string& path, const Document& doc, std::uint32_t sequence = 0);
+
+/**
+ * Load the document at \p path, replacing \p doc. Documents saved without
+ * layers are loaded into a single layer.
+ *
+ * Text is not copied, but refers to the memory-mapped file. Returns if
+ * loaded successfully, otherwise \p doc is unchanged. If \p sequence is not
+ * null, it is set to the sequence stored in the file.
+ */
+bool load_document(const std::string& path, Document& doc, std::uint32_t* sequence = nullptr);
+
+/**
+ * Load the document in \p data (e.g. received from elsewhere), in the same way
+ * as the above. Text refers to \p data, which must stay valid as long as \p
+ * owner does.
+ */
+bool load_document(strview data, std::shared_ptr<const void> owner, Document& doc,
+	std::uint32_t* sequence = nullptr);
+
+/**
+ * Encode the elements of \p es (without any styles) in the same format as a
+ * document. This is used to store elements outside of a document.
+ */
+std::string encode_elements(const ElementStack& es);
+
+/**
+ * Decode elements encoded by encode_elements(), adding them to \p out. Styles
+ * ids refer to the styles in \p msm. Text refers to \p data, which must stay
+ * valid as long as \p owner does. Returns if decoded successfully.
+ */
+bool decode_elements(strview data, std::shared_ptr<const void> owner, ElementStack& out, const MultiStyleManager& msm);
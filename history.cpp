@@ -0,0 +1,170 @@
+#include "history.hpp"
+
+#include "item/arrow.hpp"
+#include "item/text.hpp"
+
+#include <iterator>
+#include <utility>
+
+/**
+ * Estimate the memory used by \p elem.
+ */
+static size_t element_cost(const Drawable& elem)
+{
+	if(auto* stack = dynamic_cast<const ElementStack*>(&elem)) {
+		size_t cost = sizeof(ElementStack) + stack->cache.cells.size() + stack->cache.pens.size()
+			+ stack->cache.junctions.links.size();
+		for(auto& inner : stack->elements) {
+			cost += sizeof(inner) + element_cost(*inner);
+		}
+		return cost;
+	} else if(auto* text = dynamic_cast<const Text*>(&elem)) {
+		// copies of the text share its storage (with the document, while
+		// it's there), so only count the nodes referring to it
+		size_t pieces = text->content().size() / Rope::leaf_size + 1;
+		return sizeof(Text) + pieces * sizeof(Rope::Node);
+	} else if(auto* arrow = dynamic_cast<const Arrow*>(&elem)) {
+		return sizeof(Arrow) + arrow->points.size() * sizeof(arrow->points[0]);
+	}
+	return 64; // small fixed-size elements
+}
+
+/**
+ * Estimate the memory used by \p changes.
+ */
+static size_t changes_cost(const std::vector<Change>& changes)
+{
+	size_t cost = 0;
+	for(auto& change : changes) {
+		cost += sizeof(Change) + change.ids.size() * sizeof(int) + change.name.size();
+		if(change.element) {
+			cost += element_cost(*change.element);
+		}
+	}
+	return cost;
+}
+
+constexpr size_t History::default_budget;
+
+void History::record(std::vector<Change> redo, std::vector<Change> undo)
+{
+	for(auto& step : undone) {
+		used -= step.cost;
+	}
+	undone.clear();
+
+	size_t cost = sizeof(Step) + changes_cost(redo) + changes_cost(undo);
+	done.push_back(Step{ std::move(redo), std::move(undo), cost });
+	used += cost;
+	this->trim();
+}
+
+void History::record(Change redo, Change undo)
+{
+	// scrolling again just scrolls further, as one step
+	if(redo.kind == Change::ShiftAll && undone.empty() && !done.empty()
+		&& done.back().redo.size() == 1 && done.back().redo[0].kind == Change::ShiftAll) {
+		Step& last = done.back();
+		last.redo[0].amount.x += redo.amount.x;
+		last.redo[0].amount.y += redo.amount.y;
+		last.undo[0].amount.x += undo.amount.x;
+		last.undo[0].amount.y += undo.amount.y;
+		if(last.redo[0].amount.x == 0 && last.redo[0].amount.y == 0) {
+			used -= last.cost; // scrolled back, so there's nothing to undo
+			done.pop_back();
+		}
+		return;
+	}
+
+	std::vector<Change> redo_list, undo_list;
+	redo_list.push_back(std::move(redo));
+	undo_list.push_back(std::move(undo));
+	this->record(std::move(redo_list), std::move(undo_list));
+}
+
+void History::set_budget(size_t bytes)
+{
+	budget = bytes;
+	this->trim();
+}
+
+const std::vector<Change>* History::undo(Document& doc, bool* complete)
+{
+	if(done.empty()) {
+		if(complete) {
+			*complete = false;
+		}
+		return nullptr;
+	}
+
+	Step step = std::move(done.back());
+	done.pop_back();
+	if(!this->apply(step.undo, doc, complete)) {
+		return &partial;
+	}
+	undone.push_back(std::move(step));
+	return &undone.back().undo;
+}
+
+const std::vector<Change>* History::redo(Document& doc, bool* complete)
+{
+	if(undone.empty()) {
+		if(complete) {
+			*complete = false;
+		}
+		return nullptr;
+	}
+
+	Step step = std::move(undone.back());
+	undone.pop_back();
+	if(!this->apply(step.redo, doc, complete)) {
+		return &partial;
+	}
+	done.push_back(std::move(step));
+	return &done.back().redo;
+}
+
+/**
+ * Apply \p changes to \p doc in order. If one doesn't fit, the history is
+ * cleared, and those already applied are moved to \a partial.
+ */
+bool History::apply(std::vector<Change>& changes, Document& doc, bool* complete)
+{
+	partial.clear();
+	for(size_t idx = 0; idx < changes.size(); ++idx) {
+		if(!apply_change(changes[idx], doc)) {
+			// the document doesn't match the history, so it's useless
+			partial.assign(std::make_move_iterator(changes.begin()),
+				std::make_move_iterator(changes.begin() + idx));
+			this->clear();
+			if(complete) {
+				*complete = false;
+			}
+			return false;
+		}
+	}
+	if(complete) {
+		*complete = true;
+	}
+	return true;
+}
+
+void History::clear()
+{
+	done.clear();
+	undone.clear();
+	used = 0;
+}
+
+void History::trim()
+{
+	// undone steps are newer, so drop the oldest done steps first
+	while(used > budget && !done.empty()) {
+		used -= done.front().cost;
+		done.pop_front();
+	}
+	while(used > budget && !undone.empty()) {
+		used -= undone.front().cost;
+		undone.erase(undone.begin());
+	}
+}
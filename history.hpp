@@ -0,0 +1,101 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines History, which allows changes to a document to be undone
+ * and redone.
+ */
+
+#include "document.hpp"
+#include "drawable.hpp"
+#include "journal.hpp"
+#include "multistyle.hpp"
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+/**
+ * Undo/redo history of a document, as records of Changes.
+ *
+ * Each step stores the changes made, along with the changes which reverse
+ * them (recorded before the document is modified, when the old state is still
+ * known). Undoing or redoing a step costs as much as the step itself, never as
+ * much as the whole document.
+ *
+ * The memory used is limited by \a budget, beyond which the oldest steps are
+ * dropped.
+ */
+struct History
+{
+	/// Default memory limit for the history (in bytes).
+	static constexpr size_t default_budget = 16 << 20;
+
+	struct Step
+	{
+		std::vector<Change> redo; // in order
+		std::vector<Change> undo; // in order, reversing redo
+		size_t cost; // approximate memory used
+	};
+
+	std::deque<Step> done; // most recent last
+	std::vector<Step> undone; // most recently undone last
+	std::vector<Change> partial; // applied from a step which didn't fit
+	size_t budget = default_budget;
+	size_t used = 0;
+public:
+	/**
+	 * Record a step made of \p redo (already applied), which is reversed
+	 * by applying \p undo in order. This discards all undone steps.
+	 */
+	void record(std::vector<Change> redo, std::vector<Change> undo);
+
+	/**
+	 * Record a step made of a single change. Consecutive ShiftAll changes
+	 * are combined into one step, so scrolling is undone all at once.
+	 */
+	void record(Change redo, Change undo);
+
+	/**
+	 * Change the memory limit to \p bytes, dropping steps if needed.
+	 */
+	void set_budget(size_t bytes);
+
+	/**
+	 * Get the changes which undo() or redo() (if \p undo isn't set) would
+	 * apply next, or nullptr if there are none.
+	 */
+	const std::vector<Change>* next(bool undo) const
+	{
+		if(undo) {
+			return done.empty() ? nullptr : &done.back().undo;
+		}
+		return undone.empty() ? nullptr : &undone.back().redo;
+	}
+
+	/**
+	 * Undo the last step, returning the changes applied (for the journal),
+	 * or nullptr if there is nothing to undo.
+	 *
+	 * If a change in the step doesn't fit the document, the history doesn't
+	 * match it, so it's cleared. The changes before that one have still
+	 * been applied, so they are returned. \p complete (if not null) is set
+	 * to whether the whole step was applied.
+	 */
+	const std::vector<Change>* undo(Document& doc, bool* complete = nullptr);
+
+	/**
+	 * Redo the last undone step, returning the changes applied, or nullptr
+	 * if there is nothing to redo. This fails in the same way as undo().
+	 */
+	const std::vector<Change>* redo(Document& doc, bool* complete = nullptr);
+
+	/**
+	 * Drop all steps.
+	 */
+	void clear();
+
+private:
+	bool apply(std::vector<Change>& changes, Document& doc, bool* complete);
+	void trim();
+};
@@ -0,0 +1,63 @@
+#include "import.hpp"
+
+#include "mapping.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+std::string clean_text(strview data)
+{
+	// written through a pointer, as lines are usually too short for
+	// appending to be fast; there is always room for the rest of the input
+	// (unless it has tabs, which are handled when found)
+	std::string out(data.size(), '\0');
+	char* dst = &out[0];
+	size_t len = 0;
+	size_t line_start = 0; // for tab stops
+
+	for(size_t pos = 0; pos < data.size(); ++pos) {
+		char c = data[pos];
+		if(static_cast<unsigned char>(c) >= ' ' && c != '\x7f') {
+			dst[len++] = c;
+			continue;
+		}
+
+		switch(c) {
+		case '\n':
+			dst[len++] = '\n';
+			line_start = len;
+			break;
+		case '\r':
+			break;
+		case '\t':
+			{
+				size_t spaces = 8 - (len - line_start) % 8;
+				size_t needed = len + spaces + (data.size() - pos - 1);
+				if(needed > out.size()) {
+					out.resize(std::max(needed, out.size() + out.size() / 2));
+					dst = &out[0];
+				}
+				std::memset(dst + len, ' ', spaces);
+				len += spaces;
+			} break;
+		default:
+			dst[len++] = ' ';
+		}
+	}
+
+	out.resize(len);
+	return out;
+}
+
+std::unique_ptr<Text> import_text(const std::string& path, int x, int y)
+{
+	auto mapping = FileMapping::open(path);
+	if(!mapping) {
+		return nullptr;
+	}
+
+	auto storage = std::make_shared<const std::string>(clean_text(mapping->contents()));
+	auto text = std::make_unique<Text>(x, y);
+	text->borrow(*storage, storage);
+	return text;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines import_text(), which reads a plain text file into a Text
+ * element in one go (e.g. a generated table or log).
+ */
+
+#include "base.hpp"
+#include "item/text.hpp"
+
+#include <memory>
+#include <string>
+
+/**
+ * Convert \p data into text which can be drawn: carriage returns are dropped,
+ * tabs are expanded to spaces (with a tab stop every 8 columns), and other
+ * control characters are replaced by spaces.
+ */
+std::string clean_text(strview data);
+
+/**
+ * Read the file at \p path into a Text with its first char at (\p x, \p y),
+ * returning null if it cannot be read.
+ *
+ * The file is memory-mapped and cleaned (see clean_text()) in a single pass,
+ * and the text is indexed as it is stored, so this is linear in the size of
+ * the file.
+ */
+std::unique_ptr<Text> import_text(const std::string& path, int x, int y);
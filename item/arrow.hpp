@@ -13,6 +13,7 @@
 #include "../style/arrow.hpp"
 
 #include <algorithm>
+#include <cstdint>
 
 /**
  * Stores a complex arrow.
@@ -34,9 +35,13 @@ public:
 	point start;
 	std::vector<std::pair<point, Direction>> points; // points to pass through, with direction
 
-	std::shared_ptr<ArrowStyle> style;
+	StyleId<ArrowStyle> style;
+
+	// the keys of the boxes the start and end are anchored to (see
+	// Box::key), or 0 if they aren't
+	std::uint32_t start_box = 0, end_box = 0;
 public:
-	Arrow(int x, int y, std::shared_ptr<ArrowStyle> style)
+	Arrow(int x, int y, StyleId<ArrowStyle> style)
 		: start(x, y), points(), style(style)
 	{
 	}
@@ -71,6 +76,51 @@ public:
 		points.emplace_back(point{x, y}, dir);
 	}
 
+	/**
+	 * Anchor the start to the box \p key, with corners \p min and \p max,
+	 * which it is on the side of (see anchor_box_at()). The first section
+	 * is turned to leave that side straight.
+	 */
+	void anchor_start(std::uint32_t key, point min, point max)
+	{
+		start_box = key;
+		if(!points.empty()) {
+			points.front().second = across(start, min, max) ? Horizontal : Vertical;
+		}
+	}
+
+	/**
+	 * Anchor the end (which must exist) to the box \p key, as
+	 * anchor_start(). The last section is turned to enter the side
+	 * straight, which takes priority over the start.
+	 */
+	void anchor_end(std::uint32_t key, point min, point max)
+	{
+		end_box = key;
+		// the direction is the one taken first, so it's the other one
+		points.back().second = across(points.back().first, min, max) ? Vertical : Horizontal;
+	}
+
+	/**
+	 * Move the ends anchored to the box \p key by (\p x, \p y), as the box
+	 * has been moved by as much. The corners next to them follow, as they
+	 * are found from the ends.
+	 */
+	void follow(std::uint32_t key, int x, int y)
+	{
+		if(key == 0) {
+			return;
+		}
+		if(start_box == key) {
+			start.x += x;
+			start.y += y;
+		}
+		if(end_box == key && !points.empty()) {
+			points.back().first.x += x;
+			points.back().first.y += y;
+		}
+	}
+
 	/**
 	 * Get notable points. This includes all markers, start/end points and
 	 * corners.
@@ -100,42 +150,90 @@ public:
 	/**
 	 * Draw the arrow.
 	 *
-	 * The parts of the arrow are drawn using the style provided.
-	 *
-	 * Currently, corners and arrowheads are not implemented.
+	 * The parts of the arrow are drawn using the style provided: lines are
+	 * joined (see Canvas::joinh()), so they have corners where they turn
+	 * and junctions where they cross others, and the end has an arrowhead
+	 * pointing the way the last section goes.
 	 */
 	virtual void draw(Canvas& canvas) const override
 	{
-		if(points.empty()) {
+		draw_path(canvas, canvas.style(style), start, points.begin(), points.end());
+	}
+
+	/**
+	 * Draw an arrow starting at \p start and passing through the segments
+	 * in [\p first, \p last) with the style \p st. Dereferencing the
+	 * iterators must give something like the elements of Arrow::points.
+	 *
+	 * This allows arrows to be drawn without having to construct one.
+	 */
+	template <typename It>
+	static void draw_path(Canvas& canvas, const ArrowStyle& st, point start, It first, It last)
+	{
+		if(first == last) {
 			return;
 		}
 
+		const LineGlyphs glyphs = st.lines();
+		char head = Canvas::Transparent; // for the last section drawn
+		bool drawn = false;
+
+		// draw a straight section, skipping empty ones so they don't
+		// break up corners
+		auto section = [&] (point from, point to) {
+			if(from.x != to.x) {
+				canvas.joinh(glyphs, from.x, from.y, to.x);
+				head = to.x > from.x ? st.right : st.left;
+				drawn = true;
+			} else if(from.y != to.y) {
+				canvas.joinv(glyphs, from.x, from.y, to.y);
+				head = to.y > from.y ? st.down : st.up;
+				drawn = true;
+			}
+		};
+
 		point from = start;
 
-		for(auto& segment : points) {
+		for(auto it = first; it != last; ++it) {
+			auto segment = *it;
 			auto& to = segment.first;
 
 			if(segment.second == Vertical) {
-				canvas.linev(style->vertical, from.x, std::min(from.y, to.y), std::max(from.y, to.y));
-				canvas.lineh(style->horizontal, std::min(from.x, to.x), to.y, std::max(from.x, to.x));
+				section(from, point(from.x, to.y));
+				section(point(from.x, to.y), to);
 			} else {
-				canvas.lineh(style->horizontal, std::min(from.x, to.x), from.y, std::max(from.x, to.x));
-				canvas.linev(style->vertical, to.x, std::min(from.y, to.y), std::max(from.y, to.y));
+				section(from, point(to.x, from.y));
+				section(point(to.x, from.y), to);
 			}
 
 			from = to;
 		}
 
-		// TODO: Corners and arrows
-		// for(auto& marker : this->get_all_markers()) {
-		// }
+		if(!drawn) {
+			// every point is the same, which still needs to be seen
+			canvas.joinh(glyphs, start.x, start.y, start.x);
+		}
 
 		// draw markers
-		for(auto& segment : points) {
-			auto& mark = segment.first;
-			canvas.set(style->marker, mark.x, mark.y);
+		for(auto it = first; it != last; ++it) {
+			auto segment = *it;
+			canvas.set(st.marker, segment.first.x, segment.first.y);
 		}
 
+		canvas.set(head, from.x, from.y);
+	}
+
+	/**
+	 * Every part of the arrow is on or between its points.
+	 */
+	virtual bool extent(Canvas& /* canvas */, point& min, point& max) const override
+	{
+		min = max = start;
+		for(auto& segment : points) {
+			min = { std::min(min.x, segment.first.x), std::min(min.y, segment.first.y) };
+			max = { std::max(max.x, segment.first.x), std::max(max.y, segment.first.y) };
+		}
+		return true;
 	}
 
 	/**
@@ -151,4 +249,15 @@ public:
 			point.first.y += y;
 		}
 	}
+
+private:
+	/**
+	 * Return if \p end is on the left or right side of the box with
+	 * corners \p min and \p max (or beside it), rather than the top or
+	 * bottom, so that a line reaches it across the side horizontally.
+	 */
+	static bool across(point end, point min, point max)
+	{
+		return end.x <= min.x || max.x <= end.x;
+	}
 };
@@ -11,6 +11,8 @@
 
 #include "../style/box.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <utility>
 
@@ -29,19 +31,23 @@ struct Box
 	int x1, y1;
 	int x2, y2;
 
-	std::shared_ptr<BoxStyle> style;
+	StyleId<BoxStyle> style;
+
+	// identifies the box to arrows anchored to it (see Arrow::start_box),
+	// unique within a layer, or 0 if none have been
+	std::uint32_t key = 0;
 public:
-	Box(std::shared_ptr<BoxStyle> style)
+	Box(StyleId<BoxStyle> style)
 		: x1(0), y1(0), x2(0), y2(0), style(style)
 	{
 	}
 
-	Box(int x, int y, std::shared_ptr<BoxStyle> style)
+	Box(int x, int y, StyleId<BoxStyle> style)
 		: x1(x), y1(y), x2(x), y2(y), style(style)
 	{
 	}
 
-	Box(int x1, int y1, int x2, int y2, std::shared_ptr<BoxStyle> style)
+	Box(int x1, int y1, int x2, int y2, StyleId<BoxStyle> style)
 		: x1(x1), y1(y1), x2(x2), y2(y2), style(style)
 	{
 	}
@@ -73,7 +79,9 @@ public:
 	/**
 	 * Draw the box.
 	 *
-	 * If the corners are transparent, they are drawn as vertical sections,
+	 * The sides are joined lines (see Canvas::joinh()), so the corners are
+	 * where they meet, and other lines meeting the sides join them. If the
+	 * corners are transparent, they are drawn as vertical sections,
 	 * otherwise horizontal if they are also transparent.
 	 */
 	virtual void draw(Canvas& canvas) const override
@@ -81,17 +89,30 @@ public:
 		auto norm = *this;
 		norm.normalise();
 
-		canvas.fill(style->fill, norm.x1, norm.y1, norm.x2, norm.y2);
+		const BoxStyle& st = canvas.style(style);
+
+		canvas.fill(st.fill, norm.x1, norm.y1, norm.x2, norm.y2);
 
-		canvas.lineh(style->tside, norm.x1, norm.y1, norm.x2);
-		canvas.lineh(style->bside, norm.x1, norm.y2, norm.x2);
-		canvas.linev(style->lside, norm.x1, norm.y1, norm.y2);
-		canvas.linev(style->rside, norm.x2, norm.y1, norm.y2);
+		canvas.joinh(st.lines(st.tside, st.lside), norm.x1, norm.y1, norm.x2);
+		canvas.joinh(st.lines(st.bside, st.lside), norm.x1, norm.y2, norm.x2);
+		canvas.joinv(st.lines(st.tside, st.lside), norm.x1, norm.y1, norm.y2);
+		canvas.joinv(st.lines(st.tside, st.rside), norm.x2, norm.y1, norm.y2);
+	}
 
-		canvas.set(style->tl_corner, norm.x1, norm.y1);
-		canvas.set(style->tr_corner, norm.x2, norm.y1);
-		canvas.set(style->bl_corner, norm.x1, norm.y2);
-		canvas.set(style->br_corner, norm.x2, norm.y2);
+	virtual bool extent(Canvas& /* canvas */, point& min, point& max) const override
+	{
+		min = { std::min(x1, x2), std::min(y1, y2) };
+		max = { std::max(x1, x2), std::max(y1, y2) };
+		return true;
+	}
+
+	/**
+	 * A box with a fill is opaque, as the fill covers the whole box
+	 * (including the sides) before they are drawn.
+	 */
+	virtual bool opaque(Canvas& canvas) const override
+	{
+		return canvas.style(style).fill != Canvas::Transparent;
 	}
 
 	/**
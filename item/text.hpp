@@ -5,23 +5,37 @@
  * This file defines Text, a Drawable which represents a block of raw text.
  */
 
+#include "../base.hpp"
 #include "../canvas.hpp"
 #include "../drawable.hpp"
+#include "../rope.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <string>
 
 /**
  * Stores a block of text.
  *
  * This type is able to store a string, which may contain line endings. When
  * rendering, this is handled correctly, aligning them to the left.
+ *
+ * The text is kept in a Rope, so it can be edited anywhere (and lines found)
+ * in O(log n), and copying a Text doesn't copy the text. The text can also be
+ * borrowed from elsewhere (e.g. a memory-mapped file), in which case only the
+ * parts which are edited are copied.
+ *
+ * Drawing only touches the lines which are visible, without allocating.
  */
 struct Text
 	: public Drawable
 {
-	std::string string;
+	Rope rope;
 	int x, y;
 public:
 	Text(int x, int y)
-		: string(), x(x), y(y)
+		: rope(), x(x), y(y)
 	{
 	}
 
@@ -34,20 +48,114 @@ public:
 	}
 
 	/**
-	 * Draw the text, correctly handling newlines.
+	 * Get the text.
+	 */
+	const Rope& content() const
+	{
+		return rope;
+	}
+
+	/**
+	 * Refer to \p text instead of storing it, which must stay valid as
+	 * long as \p keep_alive does.
+	 */
+	void borrow(strview text, std::shared_ptr<const void> keep_alive)
+	{
+		rope = Rope(text, std::move(keep_alive));
+	}
+
+	/**
+	 * Get the offset in the text of the cell (\p px, \p py), moved to the
+	 * nearest position within the text.
+	 */
+	size_t offset_at(int px, int py) const
+	{
+		long long line = std::max(0ll, std::min<long long>(static_cast<long long>(py) - y, rope.lines() - 1));
+		long long column = std::max(0ll, static_cast<long long>(px) - x);
+		size_t length = rope.line_length(line);
+		return rope.line_start(line) + std::min<size_t>(column, length);
+	}
+
+	/**
+	 * Get the cell of the char at \p offset in the text.
+	 */
+	point position_of(size_t offset) const
+	{
+		size_t line = rope.line_of(offset);
+		return { x + static_cast<int>(offset - rope.line_start(line)), y + static_cast<int>(line) };
+	}
+
+	/**
+	 * Draw the text, correctly handling newlines. Only the lines within
+	 * the visible region of \p canvas are drawn.
 	 */
 	virtual void draw(Canvas& canvas) const override
 	{
-		int line_y = y;
+		// long long, as the visible region may be unlimited
+		long long lines = rope.lines();
+		long long line = std::max(0ll, static_cast<long long>(canvas.visible_min.y) - y);
+		long long last = std::min(lines, static_cast<long long>(canvas.visible_max.y) - y + 1);
+		if(line >= last) {
+			return;
+		}
+
+		// lines can span pieces, so draw each part at its column
+		int column = 0;
+		rope.for_each_piece(rope.line_start(line), [&] (strview piece) {
+			size_t start = 0;
+			while(true) {
+				size_t end = piece.find('\n', start);
+				canvas.direct(piece.substr(start, end - start), x + column, y + static_cast<int>(line));
+				if(end == strview::npos) {
+					column += static_cast<int>(piece.size() - start);
+					return true;
+				}
+				start = end + 1;
+				column = 0;
+				if(++line >= last) {
+					return false;
+				}
+			}
+		});
+	}
+
+	/**
+	 * Draw \p text with the first character at (\p x, \p y), handling
+	 * newlines in the same way as Text.
+	 *
+	 * Without an index, lines above the visible region are still scanned
+	 * for, but nothing after it is.
+	 */
+	static void draw_text(Canvas& canvas, strview text, int x, int y)
+	{
+		long long line_y = y;
 		size_t start = 0;
 
-		do {
-			size_t end = string.find('\n', start);
-			canvas.direct(string.substr(start, end - start), x, line_y);
+		while(line_y <= canvas.visible_max.y) {
+			size_t end = text.find('\n', start);
+			if(line_y >= canvas.visible_min.y) {
+				canvas.direct(text.substr(start, end - start), x, static_cast<int>(line_y));
+			}
+			if(end == strview::npos) {
+				break;
+			}
 			start = end + 1;
-
 			++line_y;
-		} while(start != std::string::npos + 1);
+		}
+	}
+
+	/**
+	 * The width is taken as the size of the whole text, as no line can be
+	 * longer, so the extent is found in O(1).
+	 */
+	virtual bool extent(Canvas& /* canvas */, point& min, point& max) const override
+	{
+		long long width = std::max<size_t>(rope.size(), 1);
+		long long lines = rope.lines();
+		min = { x, y };
+		max = { static_cast<int>(std::min<long long>(INT_MAX, x + width - 1)),
+			static_cast<int>(std::min<long long>(INT_MAX, y + lines - 1)) };
+		return true;
 	}
 
 	/**
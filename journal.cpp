@@ -0,0 +1,501 @@
+#include "journal.hpp"
+
+#include "fileformat.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+
+static const char journal_magic[8] = { 'a', 'g', 'j', 'o', 'u', 'r', 'n', 'l' };
+static const std::uint32_t journal_version = 1;
+
+/**
+ * A FNV-1a hash, used to detect records which were only partially written.
+ */
+static std::uint32_t checksum(strview data)
+{
+	std::uint32_t hash = 2166136261u;
+	for(char c : data) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * The fixed-size part of an encoded change. This is followed by the ids, and
+ * then the encoded element (or the name of a layer added).
+ */
+struct ChangeRecord
+{
+	std::uint32_t sequence;
+	std::uint16_t kind;
+	std::uint16_t reserved;
+	std::int32_t index, other;
+	std::int32_t amount_x, amount_y;
+	std::uint32_t slot, style, part;
+	std::int8_t value;
+	std::uint8_t reserved2[3];
+	std::uint32_t id_count;
+	std::uint32_t element_size;
+};
+
+static_assert(sizeof(ChangeRecord) == 48, "ChangeRecord must not have padding");
+
+/**
+ * Encode \p change as a journal entry, including the length and checksum.
+ */
+static void encode_change(const Change& change, std::uint32_t sequence, std::string& out)
+{
+	std::string element;
+	if(change.element) {
+		ElementStack wrapper; // encode_elements takes a stack
+		wrapper.elements.push_back(change.element->clone());
+		element = encode_elements(wrapper);
+	} else if(change.kind == Change::LayerAdd) {
+		element = change.name;
+	}
+
+	ChangeRecord rec{};
+	rec.sequence = sequence;
+	rec.kind = change.kind;
+	rec.index = change.index;
+	rec.other = change.other;
+	rec.amount_x = change.amount.x;
+	rec.amount_y = change.amount.y;
+	rec.slot = change.slot;
+	rec.style = change.style;
+	rec.part = change.part;
+	rec.value = change.value;
+	rec.id_count = change.ids.size();
+	rec.element_size = element.size();
+
+	std::string body;
+	body.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+	for(std::int32_t id : change.ids) {
+		body.append(reinterpret_cast<const char*>(&id), sizeof(id));
+	}
+	body += element;
+
+	std::uint32_t frame[2] = { static_cast<std::uint32_t>(body.size()), checksum(body) };
+	out.append(reinterpret_cast<const char*>(frame), sizeof(frame));
+	out += body;
+}
+
+/**
+ * Decode a journal entry body (without the length and checksum). Style ids of
+ * the element refer to \p msm.
+ */
+static bool decode_change(strview body, const MultiStyleManager& msm, Change& change, std::uint32_t& sequence)
+{
+	ChangeRecord rec;
+	if(body.size() < sizeof(rec)) {
+		return false;
+	}
+	std::memcpy(&rec, body.data(), sizeof(rec));
+
+	if(rec.id_count > (body.size() - sizeof(rec)) / 4
+		|| rec.element_size != body.size() - sizeof(rec) - rec.id_count * 4) {
+		return false;
+	}
+
+	sequence = rec.sequence;
+	change = Change{ static_cast<Change::Kind>(rec.kind) };
+	change.index = rec.index;
+	change.other = rec.other;
+	change.amount = { rec.amount_x, rec.amount_y };
+	change.slot = rec.slot;
+	change.style = rec.style;
+	change.part = rec.part;
+	change.value = rec.value;
+
+	const char* ids = body.data() + sizeof(rec);
+	for(std::uint32_t idx = 0; idx < rec.id_count; ++idx) {
+		std::int32_t id;
+		std::memcpy(&id, ids + idx * 4, sizeof(id));
+		change.ids.push_back(id);
+	}
+
+	if(change.kind == Change::LayerAdd) {
+		change.name = std::string(ids + rec.id_count * 4, rec.element_size);
+	} else if(rec.element_size > 0) {
+		// copied, so that it's aligned and outlives the journal
+		auto data = std::make_shared<std::string>(ids + rec.id_count * 4, rec.element_size);
+		ElementStack wrapper;
+		if(!decode_elements(*data, data, wrapper, msm) || wrapper.elements.size() != 1) {
+			return false;
+		}
+		change.element = std::move(wrapper.elements.front());
+	}
+	return true;
+}
+
+/**
+ * Call \p fn with the sequence and body of every valid entry in the journal
+ * \p contents, stopping at the first invalid one (e.g. partially written).
+ * Returns the length of the valid part, or 0 if there is no valid header.
+ */
+template <typename Fn>
+static size_t read_journal(strview contents, Fn&& fn)
+{
+	const size_t header_size = sizeof(journal_magic) + 8;
+	if(contents.size() < header_size || std::memcmp(contents.data(), journal_magic, sizeof(journal_magic)) != 0) {
+		return 0;
+	}
+
+	std::uint32_t version[2];
+	std::memcpy(version, contents.data() + sizeof(journal_magic), sizeof(version));
+	if(version[0] != journal_version || version[1] != file_byte_order) {
+		return 0;
+	}
+
+	size_t pos = header_size;
+	while(contents.size() - pos >= 8) {
+		std::uint32_t frame[2];
+		std::memcpy(frame, contents.data() + pos, sizeof(frame));
+		if(frame[0] > contents.size() - pos - 8) {
+			break;
+		}
+		strview body = contents.substr(pos + 8, frame[0]);
+		if(checksum(body) != frame[1] || !fn(body)) {
+			break;
+		}
+		pos += 8 + frame[0];
+	}
+	return pos;
+}
+
+/**
+ * Create a new empty journal at \p path, returning the open file.
+ */
+static std::FILE* create_journal(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if(file) {
+		std::uint32_t version[2] = { journal_version, file_byte_order };
+		std::fwrite(journal_magic, 1, sizeof(journal_magic), file);
+		std::fwrite(version, 1, sizeof(version), file);
+		sync_file(file);
+	}
+	return file;
+}
+
+bool apply_change(const Change& change, Document& doc)
+{
+	ElementStack& es = doc.es;
+	MultiStyleManager& msm = doc.msm;
+	int layers = doc.layers.size();
+	int size = es.elements.size();
+	auto valid = [&] (int idx) { return 0 <= idx && idx < size; };
+	auto valid_ids = [&] {
+		for(size_t idx = 0; idx < change.ids.size(); ++idx) {
+			if(!valid(change.ids[idx]) || (idx > 0 && change.ids[idx - 1] >= change.ids[idx])) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	switch(change.kind) {
+	case Change::Insert:
+		if(!change.element || change.index < 0 || change.index > size) {
+			return false;
+		}
+		es.elements.insert(es.elements.begin() + change.index, change.element->clone());
+		break;
+	case Change::Replace:
+		if(!change.element || !valid(change.index)) {
+			return false;
+		}
+		es.elements[change.index] = change.element->clone();
+		break;
+	case Change::Erase:
+		if(!valid(change.index)) {
+			return false;
+		}
+		es.elements.erase(es.elements.begin() + change.index);
+		break;
+	case Change::Shift:
+		if(!valid(change.index)) {
+			return false;
+		}
+		es.elements[change.index]->shift(change.amount.x, change.amount.y);
+		break;
+	case Change::ShiftAll:
+		doc.shift_all(change.amount.x, change.amount.y);
+		break;
+	case Change::Swap:
+		if(!valid(change.index) || !valid(change.other)) {
+			return false;
+		}
+		std::swap(es.elements[change.index], es.elements[change.other]);
+		break;
+	case Change::Group:
+		if(!valid_ids()) {
+			return false;
+		}
+		es.elements.push_back(std::make_unique<ElementStack>(es.extract(change.ids)));
+		es.back_as<ElementStack>()->use_cache = true;
+		break;
+	case Change::EraseMany:
+		if(!valid_ids()) {
+			return false;
+		}
+		es.extract(change.ids);
+		break;
+	case Change::StylePart:
+	case Change::StyleAdd:
+	case Change::StyleRotate:
+	case Change::StyleOrder:
+		{
+			bool ok = false;
+			msm.visit(change.slot, [&] (auto& sm) {
+				using T = typename std::decay_t<decltype(sm)>::style_type;
+				if(change.kind == Change::StylePart) {
+					if(change.style >= sm.table.size() || change.part >= style_parts<T>.size()) {
+						return;
+					}
+					StyleId<T> id{ change.style };
+					sm.table[id].*style_parts<T>[change.part].member = change.value;
+					sm.table.modified(id);
+				} else if(change.kind == Change::StyleAdd) {
+					sm.duplicate_first();
+				} else if(change.kind == Change::StyleOrder) {
+					if(change.ids.empty()) {
+						return;
+					}
+					std::vector<StyleId<T>> order;
+					for(int id : change.ids) {
+						if(id < 0 || static_cast<size_t>(id) >= sm.table.size()) {
+							return;
+						}
+						order.push_back(StyleId<T>{ static_cast<std::uint32_t>(id) });
+					}
+					sm.styles = std::move(order);
+				} else if(change.amount.x > 0) {
+					sm.unshift();
+				} else {
+					sm.shift();
+				}
+				ok = true;
+			});
+			return ok;
+		}
+	case Change::LayerAdd:
+		if(change.index < 0 || change.index > layers) {
+			return false;
+		}
+		doc.insert_layer(change.index, change.name);
+		break;
+	case Change::LayerErase:
+		if(change.index < 0 || !doc.erase_layer(change.index)) {
+			return false;
+		}
+		break;
+	case Change::LayerSelect:
+		if(change.index < 0 || change.index >= layers) {
+			return false;
+		}
+		doc.select_layer(change.index);
+		break;
+	case Change::LayerState:
+		if(change.index < 0 || change.index >= layers) {
+			return false;
+		}
+		doc.layers[change.index].set_flags(change.other);
+		break;
+	default:
+		return false;
+	}
+
+	es.invalidate();
+	return true;
+}
+
+bool recover_document(const std::string& path, Document& doc, std::uint32_t& sequence)
+{
+	sequence = 0;
+
+	Document loaded;
+	if(auto file = std::fopen(path.c_str(), "rb")) {
+		std::fclose(file);
+		if(!load_document(path, loaded, &sequence)) {
+			return false; // don't replace a document we can't read
+		}
+	}
+
+	if(auto journal = FileMapping::open(path + ".journal")) {
+		read_journal(journal->contents(), [&] (strview body) {
+			Change change{Change::Insert};
+			std::uint32_t change_sequence;
+			if(!decode_change(body, loaded.msm, change, change_sequence)) {
+				return false;
+			}
+			if(change_sequence <= sequence) {
+				return true; // already in the snapshot
+			}
+			if(!apply_change(change, loaded)) {
+				return false;
+			}
+			sequence = change_sequence;
+			return true;
+		});
+	}
+
+	doc = std::move(loaded);
+	doc.es.invalidate();
+	return true;
+}
+
+constexpr long Journal::compact_size;
+constexpr int Journal::compact_seconds;
+
+bool Journal::open(const std::string& path, std::uint32_t last_sequence)
+{
+	this->close();
+
+	snapshot_path = path;
+	journal_path = path + ".journal";
+	sequence = last_sequence;
+	stopping = false;
+	compact_requested = false;
+
+	// keep the valid part of an existing journal, dropping anything after
+	// (e.g. partially written, or not applied by recover_document)
+	std::string existing;
+	if(auto mapping = FileMapping::open(journal_path)) {
+		size_t valid = read_journal(mapping->contents(), [&] (strview body) {
+			std::uint32_t change_sequence;
+			if(body.size() < sizeof(ChangeRecord)) {
+				return false;
+			}
+			std::memcpy(&change_sequence, body.data(), sizeof(change_sequence));
+			return change_sequence <= last_sequence;
+		});
+		existing = mapping->contents().substr(0, valid).str();
+	}
+
+	if(existing.empty()) {
+		file = create_journal(journal_path);
+	} else {
+		// rewritten through a temporary file, so the journal is never lost
+		std::string tmp_path = journal_path + ".tmp";
+		file = std::fopen(tmp_path.c_str(), "wb");
+		if(file) {
+			std::fwrite(existing.data(), 1, existing.size(), file);
+			if(!sync_file(file) || std::rename(tmp_path.c_str(), journal_path.c_str()) != 0
+				|| !sync_directory_of(journal_path)) {
+				std::fclose(file);
+				file = nullptr;
+			}
+		}
+	}
+	if(!file) {
+		return false;
+	}
+	journal_size = std::ftell(file);
+
+	worker = std::thread([this] { this->run(); });
+	return true;
+}
+
+void Journal::append(const Change& change)
+{
+	std::lock_guard<std::mutex> lock{mutex};
+	++sequence;
+	if(this->is_open()) {
+		encode_change(change, sequence, pending);
+	}
+}
+
+std::uint32_t Journal::last_sequence()
+{
+	std::lock_guard<std::mutex> lock{mutex};
+	return sequence;
+}
+
+void Journal::request_compact()
+{
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		compact_requested = true;
+	}
+	wake.notify_one();
+}
+
+void Journal::close()
+{
+	if(!this->is_open()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		stopping = true;
+		compact_requested = true;
+	}
+	wake.notify_one();
+	worker.join();
+
+	std::fclose(file);
+	file = nullptr;
+}
+
+void Journal::run()
+{
+	auto last_compact = std::chrono::steady_clock::now();
+
+	while(true) {
+		std::string writing;
+		bool compacting, stop;
+		{
+			std::unique_lock<std::mutex> lock{mutex};
+			wake.wait_for(lock, std::chrono::seconds(1), [this] { return stopping || compact_requested; });
+			std::swap(writing, pending);
+			compacting = compact_requested;
+			stop = stopping;
+			compact_requested = false;
+		}
+
+		if(!writing.empty()) {
+			std::fwrite(writing.data(), 1, writing.size(), file);
+			sync_file(file);
+			journal_size += writing.size();
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		bool has_changes = journal_size > static_cast<long>(sizeof(journal_magic) + 8);
+		if(has_changes && (compacting || journal_size > compact_size
+				|| now - last_compact > std::chrono::seconds(compact_seconds))) {
+			this->compact();
+			last_compact = now;
+		}
+
+		if(stop) {
+			break;
+		}
+	}
+}
+
+bool Journal::compact()
+{
+	// rebuild from the files, so the document being edited isn't touched
+	Document doc;
+	std::uint32_t last;
+	if(!recover_document(snapshot_path, doc, last)) {
+		return false;
+	}
+	if(!save_document(snapshot_path, doc, last)) {
+		return false;
+	}
+
+	// everything is in the snapshot, so start a new journal
+	std::fclose(file);
+	file = create_journal(journal_path);
+	if(!file) {
+		// try again next time, replaying the old journal is harmless
+		file = std::fopen(journal_path.c_str(), "ab");
+		return false;
+	}
+	journal_size = std::ftell(file);
+	return true;
+}
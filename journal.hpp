@@ -0,0 +1,308 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines Change, a record of a single modification to a document,
+ * and Journal, which saves changes to a file as they are made.
+ *
+ * A document on disk consists of a snapshot (a normal document file) and a
+ * journal next to it (with ".journal" appended), containing the changes made
+ * since the snapshot. Appending a change costs as much as the change itself,
+ * and is done on a background thread, which also compacts the journal into a
+ * new snapshot from time to time.
+ */
+
+#include "base.hpp"
+#include "document.hpp"
+#include "drawable.hpp"
+#include "multistyle.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A single modification to a document.
+ *
+ * Only the fields relevant to the kind are used. Use the static methods to
+ * create one.
+ */
+struct Change
+{
+	enum Kind : std::uint16_t
+	{
+		Insert,      ///< Insert element at index
+		Replace,     ///< Replace the element at index with element
+		Erase,       ///< Remove the element at index
+		Shift,       ///< Move the element at index by amount
+		ShiftAll,    ///< Move all elements by amount
+		Swap,        ///< Swap the elements at index and other
+		Group,       ///< Group the elements at ids (see ElementStack::extract) at the top
+		EraseMany,   ///< Remove the elements at ids
+		StylePart,   ///< Set the part of style to value
+		StyleAdd,    ///< Duplicate the first style of slot
+		StyleRotate, ///< Rotate the styles of slot, making the 2nd first if amount.x > 0
+		StyleOrder,  ///< Set the display order of the styles of slot to ids
+		LayerAdd,    ///< Add an empty layer called name at index
+		LayerErase,  ///< Remove the empty layer at index
+		LayerSelect, ///< Edit the layer at index, so later changes apply to it
+		LayerState,  ///< Set the LayerFlags of the layer at index to other
+	};
+
+	Kind kind;
+	int index = 0;
+	int other = 0;
+	point amount = { 0, 0 };
+	std::vector<int> ids; // sorted, except for StyleOrder
+	std::unique_ptr<Drawable> element;
+
+	std::uint32_t slot = 0; // see style_slot
+	std::uint32_t style = 0;
+	std::uint32_t part = 0;
+	char value = 0;
+
+	std::string name;
+public:
+	explicit Change(Kind kind)
+		: kind(kind)
+	{
+	}
+
+	static Change insert(int index, const Drawable& elem)
+	{
+		Change change{Insert};
+		change.index = index;
+		change.element = elem.clone();
+		return change;
+	}
+
+	static Change replace(int index, const Drawable& elem)
+	{
+		Change change{Replace};
+		change.index = index;
+		change.element = elem.clone();
+		return change;
+	}
+
+	static Change erase(int index)
+	{
+		Change change{Erase};
+		change.index = index;
+		return change;
+	}
+
+	static Change shift(int index, int x, int y)
+	{
+		Change change{Shift};
+		change.index = index;
+		change.amount = { x, y };
+		return change;
+	}
+
+	static Change shift_all(int x, int y)
+	{
+		Change change{ShiftAll};
+		change.amount = { x, y };
+		return change;
+	}
+
+	static Change swap(int index, int other)
+	{
+		Change change{Swap};
+		change.index = index;
+		change.other = other;
+		return change;
+	}
+
+	static Change group(std::vector<int> ids)
+	{
+		Change change{Group};
+		change.ids = std::move(ids);
+		return change;
+	}
+
+	static Change erase_many(std::vector<int> ids)
+	{
+		Change change{EraseMany};
+		change.ids = std::move(ids);
+		return change;
+	}
+
+	static Change layer_add(int index, std::string name)
+	{
+		Change change{LayerAdd};
+		change.index = index;
+		change.name = std::move(name);
+		return change;
+	}
+
+	static Change layer_erase(int index)
+	{
+		Change change{LayerErase};
+		change.index = index;
+		return change;
+	}
+
+	static Change layer_select(int index)
+	{
+		Change change{LayerSelect};
+		change.index = index;
+		return change;
+	}
+
+	static Change layer_state(int index, std::uint8_t flags)
+	{
+		Change change{LayerState};
+		change.index = index;
+		change.other = flags;
+		return change;
+	}
+
+	template <typename T>
+	static Change style_part(StyleId<T> id, size_t part, char value)
+	{
+		Change change{StylePart};
+		change.slot = style_slot<T>;
+		change.style = id.value;
+		change.part = part;
+		change.value = value;
+		return change;
+	}
+
+	template <typename T>
+	static Change style_add()
+	{
+		Change change{StyleAdd};
+		change.slot = style_slot<T>;
+		return change;
+	}
+
+	template <typename T>
+	static Change style_rotate(int direction)
+	{
+		Change change{StyleRotate};
+		change.slot = style_slot<T>;
+		change.amount = { direction, 0 };
+		return change;
+	}
+
+	template <typename T>
+	static Change style_order(const std::vector<StyleId<T>>& order)
+	{
+		Change change{StyleOrder};
+		change.slot = style_slot<T>;
+		for(auto id : order) {
+			change.ids.push_back(id.value);
+		}
+		return change;
+	}
+
+	/**
+	 * Return if this changes the elements of the active layer (as opposed
+	 * to styles, layers, or everything at once, like ShiftAll).
+	 */
+	bool edits_elements() const
+	{
+		return kind <= EraseMany && kind != ShiftAll;
+	}
+};
+
+/**
+ * Apply \p change to \p doc. Changes to elements apply to the active layer.
+ * Returns false (without changing anything) if the change doesn't fit the
+ * document, e.g. an index is out of range.
+ */
+bool apply_change(const Change& change, Document& doc);
+
+/**
+ * Load the snapshot at \p path (if it exists) and apply the changes in its
+ * journal, replacing \p doc. \p sequence is set to the sequence of the last
+ * change applied.
+ *
+ * Returns false if the snapshot exists but can't be loaded.
+ */
+bool recover_document(const std::string& path, Document& doc, std::uint32_t& sequence);
+
+/**
+ * Saves changes to the journal of a document, in the background.
+ *
+ * Changes are encoded when appended, and written (and synced) on a background
+ * thread, which also compacts the journal into the snapshot regularly.
+ */
+struct Journal
+{
+	/// Compact when the journal grows this large (in bytes).
+	static constexpr long compact_size = 8 << 20;
+	/// Compact after this many seconds, if there are changes.
+	static constexpr int compact_seconds = 60;
+
+	std::string snapshot_path, journal_path;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::string pending; // encoded changes not written yet
+	std::uint32_t sequence = 0;
+	bool compact_requested = false;
+	bool stopping = false;
+
+	// only used by the background thread
+	std::FILE* file = nullptr;
+	long journal_size = 0;
+
+	std::thread worker;
+public:
+	Journal() = default;
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+
+	~Journal()
+	{
+		this->close();
+	}
+
+	/**
+	 * Start journaling changes to the document at \p path, continuing
+	 * after \p last_sequence (as given by recover_document()). Returns
+	 * false if the journal cannot be written.
+	 */
+	bool open(const std::string& path, std::uint32_t last_sequence);
+
+	/**
+	 * Return if the journal is open.
+	 */
+	bool is_open() const
+	{
+		return worker.joinable();
+	}
+
+	/**
+	 * Record \p change, which has already been applied to the document.
+	 * This only counts the change if the journal is not open.
+	 */
+	void append(const Change& change);
+
+	/**
+	 * The sequence of the last change appended, which changes whenever the
+	 * document does.
+	 */
+	std::uint32_t last_sequence();
+
+	/**
+	 * Ask the background thread to update the snapshot soon.
+	 */
+	void request_compact();
+
+	/**
+	 * Write all pending changes, compact, and stop the background thread.
+	 */
+	void close();
+
+private:
+	void run();
+	bool compact();
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines LineGlyphs, the glyphs for each way lines can pass through
+ * a cell, and Junctions, which joins up lines drawn into a buffer of cells.
+ */
+
+#include "style.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// The directions a line can leave a cell in, as bits of a mask.
+enum LineDir : std::uint8_t
+{
+	LineUp    = 1,
+	LineRight = 2,
+	LineDown  = 4,
+	LineLeft  = 8,
+};
+
+/**
+ * Get the directions in which a line from \p first to \p last (along one
+ * axis, in order) leaves the cell at \p pos: \p back towards \p first and
+ * \p forward towards \p last.
+ */
+inline std::uint8_t line_links(int pos, int first, int last, LineDir back, LineDir forward)
+{
+	std::uint8_t links = 0;
+	if(pos > first) {
+		links |= back;
+	}
+	if(pos < last) {
+		links |= forward;
+	}
+	return links;
+}
+
+/**
+ * The glyphs to draw lines of a style with, for each part of a line.
+ */
+struct LineGlyphs
+{
+	enum Part : std::uint8_t
+	{
+		Vertical,
+		Horizontal,
+		TopLeft,     ///< A corner going right and down.
+		TopRight,    ///< A corner going left and down.
+		BottomLeft,  ///< A corner going right and up.
+		BottomRight, ///< A corner going left and up.
+		Junction,    ///< Where three or four directions meet.
+		PartCount
+	};
+
+	char parts[PartCount];
+public:
+	/**
+	 * Get the part for a cell which lines leave in the directions \p links
+	 * (a mask of LineDir). A single direction is the end of a line, so is
+	 * drawn as the line itself.
+	 */
+	static constexpr Part part_of(std::uint8_t links)
+	{
+		constexpr Part table[16] = {
+			Horizontal,  // none (a single cell)
+			Vertical,    // up
+			Horizontal,  // right
+			BottomLeft,  // up right
+			Vertical,    // down
+			Vertical,    // up down
+			TopLeft,     // right down
+			Junction,    // up right down
+			Horizontal,  // left
+			BottomRight, // up left
+			Horizontal,  // right left
+			Junction,    // up right left
+			TopRight,    // down left
+			Junction,    // up down left
+			Junction,    // right down left
+			Junction,    // all
+		};
+		return table[links & 15];
+	}
+
+	/**
+	 * Get the glyph for a cell which lines leave in the directions \p links.
+	 */
+	char operator[](std::uint8_t links) const
+	{
+		return parts[part_of(links)];
+	}
+};
+
+static_assert(LineGlyphs::part_of(LineRight | LineDown) == LineGlyphs::TopLeft, "corners must match their directions");
+static_assert(LineGlyphs::part_of(LineUp | LineLeft) == LineGlyphs::BottomRight, "corners must match their directions");
+
+/**
+ * The operations on a type of cell (\p Cell) in a buffer, which are defined
+ * for each type in cell.hpp.
+ */
+template <typename Cell>
+struct CellTraits;
+
+/**
+ * The directions lines leave each cell of a buffer in, kept alongside the
+ * cells (in the same row-major layout) so that lines drawn across or into
+ * each other are joined up with corners and junctions.
+ *
+ * Each cell's glyph is chosen as lines are drawn through it, from the union
+ * of the directions so far, so no separate pass over the buffer is needed.
+ * Anything else drawn over a cell must clear() it, so that lines which are
+ * no longer visible don't join with later ones.
+ */
+struct Junctions
+{
+	int width = 0, height = 0;
+	std::vector<std::uint8_t> links; // a mask of LineDir for each cell
+public:
+	/**
+	 * Forget every line, and change the size to \p w by \p h cells.
+	 */
+	void reset(int w, int h)
+	{
+		width = w;
+		height = h;
+		links.assign(static_cast<size_t>(w) * h, 0);
+	}
+
+	/**
+	 * Forget the lines through the \p count cells starting at (\p x, \p y),
+	 * which must be in the buffer.
+	 */
+	void clear(int x, int y, int count)
+	{
+		std::memset(&links[static_cast<size_t>(y) * width + x], 0, count);
+	}
+
+	/**
+	 * Get the directions for row \p y.
+	 */
+	const std::uint8_t* row(int y) const
+	{
+		return links.data() + static_cast<size_t>(y) * width;
+	}
+
+	/**
+	 * Set the directions lines leave the cell at (\p x, \p y) in to \p
+	 * mask, replacing any lines through it.
+	 */
+	void set(int x, int y, std::uint8_t mask)
+	{
+		links[static_cast<size_t>(y) * width + x] = mask;
+	}
+
+	/**
+	 * Draw a horizontal line from (\p x1, \p y) to (\p x2, \p y) inclusive
+	 * into \p cells, with \p glyphs and \p pen. The line may extend
+	 * outside the buffer, in which case it is clipped, but its ends still
+	 * count.
+	 */
+	template <typename Cell>
+	void joinh(Cell* cells, const LineGlyphs& glyphs, Pen pen, int x1, int y, int x2)
+	{
+		if(y < 0 || height <= y) {
+			return;
+		}
+		size_t row = static_cast<size_t>(y) * width;
+		int last = std::min(x2, width - 1);
+		for(int x = std::max(x1, 0); x <= last; ++x) {
+			std::uint8_t& mask = links[row + x];
+			mask |= line_links(x, x1, x2, LineLeft, LineRight);
+			put(cells[row + x], glyphs, pen, mask ? mask : LineLeft | LineRight);
+		}
+	}
+
+	/**
+	 * Draw a vertical line from (\p x, \p y1) to (\p x, \p y2) inclusive
+	 * into \p cells, with \p glyphs and \p pen (see joinh()).
+	 */
+	template <typename Cell>
+	void joinv(Cell* cells, const LineGlyphs& glyphs, Pen pen, int x, int y1, int y2)
+	{
+		if(x < 0 || width <= x) {
+			return;
+		}
+		int last = std::min(y2, height - 1);
+		for(int y = std::max(y1, 0); y <= last; ++y) {
+			size_t idx = static_cast<size_t>(y) * width + x;
+			links[idx] |= line_links(y, y1, y2, LineUp, LineDown);
+			put(cells[idx], glyphs, pen, links[idx] ? links[idx] : LineUp | LineDown);
+		}
+	}
+
+private:
+	/**
+	 * Set \p cell to the glyph for a line with \p shape (a single cell is
+	 * drawn as if the line went through it), drawn with \p pen.
+	 * Transparent glyphs leave the cell as it was.
+	 */
+	template <typename Cell>
+	static void put(Cell& cell, const LineGlyphs& glyphs, Pen pen, std::uint8_t shape)
+	{
+		char glyph = glyphs[shape];
+		if(glyph != '\0') {
+			cell = CellTraits<Cell>::line(glyph, shape, pen);
+		}
+	}
+};
@@ -0,0 +1,114 @@
+#include "mapping.hpp"
+
+#include <cstdio>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileMapping::~FileMapping()
+{
+#ifdef HAVE_MMAP
+	if(mapped) {
+		munmap(const_cast<char*>(data), size);
+		return;
+	}
+#endif
+	delete[] data;
+}
+
+/**
+ * Read the file normally, for when it can't be mapped.
+ */
+static std::shared_ptr<const FileMapping> read_whole(const std::string& path)
+{
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if(!file) {
+		return nullptr;
+	}
+
+	std::vector<char> buf;
+	char chunk[1 << 16];
+	size_t got;
+	while((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		buf.insert(buf.end(), chunk, chunk + got);
+	}
+	bool failed = std::ferror(file);
+	std::fclose(file);
+	if(failed) {
+		return nullptr;
+	}
+
+	auto mapping = std::make_shared<FileMapping>();
+	char* owned = new char[buf.size() + 1]; // never zero-sized
+	std::copy(buf.begin(), buf.end(), owned);
+	mapping->data = owned;
+	mapping->size = buf.size();
+	return mapping;
+}
+
+std::shared_ptr<const FileMapping> FileMapping::open(const std::string& path)
+{
+#ifdef HAVE_MMAP
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return nullptr;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		// empty files can't be mapped, and pipes etc. need to be read
+		::close(fd);
+		return read_whole(path);
+	}
+
+	void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping stays valid
+	if(addr == MAP_FAILED) {
+		return read_whole(path);
+	}
+
+	auto mapping = std::make_shared<FileMapping>();
+	mapping->data = static_cast<const char*>(addr);
+	mapping->size = st.st_size;
+	mapping->mapped = true;
+	return mapping;
+#else
+	return read_whole(path);
+#endif
+}
+
+bool sync_file(std::FILE* file)
+{
+	if(std::fflush(file) != 0) {
+		return false;
+	}
+#if defined(__unix__) || defined(__APPLE__)
+	return fsync(fileno(file)) == 0;
+#else
+	return true;
+#endif
+}
+
+bool sync_directory_of(const std::string& path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	size_t slash = path.rfind('/');
+	std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+	int fd = ::open(dir.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return false;
+	}
+	bool ok = fsync(fd) == 0;
+	::close(fd);
+	return ok;
+#else
+	(void)path;
+	return true;
+#endif
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines FileMapping, which provides read-only access to the
+ * contents of a file without copying it, as well as functions for making sure
+ * files written are on disk.
+ */
+
+#include "base.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+/**
+ * Read-only contents of a file, memory-mapped where supported.
+ *
+ * This is usually held through a shared_ptr, so that anything referring to
+ * the contents (e.g. text loaded from a document) can keep it alive.
+ */
+struct FileMapping
+{
+	const char* data = nullptr;
+	size_t size = 0;
+
+	bool mapped = false; // otherwise, data is owned and was read normally
+public:
+	FileMapping() = default;
+	FileMapping(const FileMapping&) = delete;
+	FileMapping& operator=(const FileMapping&) = delete;
+	~FileMapping();
+
+	/**
+	 * Get the whole file contents.
+	 */
+	strview contents() const
+	{
+		return { data, size };
+	}
+
+	/**
+	 * Map the file at \p path, returning null if it cannot be read.
+	 */
+	static std::shared_ptr<const FileMapping> open(const std::string& path);
+};
+
+/**
+ * Flush \p file and wait until its contents are on disk, so that they survive
+ * a crash or power loss. Returns false on failure.
+ */
+bool sync_file(std::FILE* file);
+
+/**
+ * Wait until the entries of the directory containing \p path are on disk, so
+ * that a file created or renamed there survives a crash or power loss. Returns
+ * false on failure. This does nothing where directories can't be synced.
+ */
+bool sync_directory_of(const std::string& path);
@@ -8,63 +8,142 @@
 
 #include "style.hpp"
 
-#include <map>
-#include <typeindex>
-#include <typeinfo>
+#include "style/arrow.hpp"
+#include "style/box.hpp"
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * A list of types, used to register style types.
+ */
+template <typename... Ts>
+struct TypeList
+{
+	static constexpr size_t size = sizeof...(Ts);
+};
+
+/**
+ * All style types, each of which gets a fixed slot (its index here). To add a
+ * new style type, append it to this list.
+ *
+ * The slots are used when saving documents, so existing types must not be
+ * reordered.
+ */
+using StyleTypes = TypeList<BoxStyle, ArrowStyle>;
+
+/**
+ * Find the index of \p T in the TypeList \p List.
+ */
+template <typename T, typename List>
+struct type_index_of;
+
+template <typename T, typename... Ts>
+struct type_index_of<T, TypeList<T, Ts...>>
+	: std::integral_constant<size_t, 0>
+{
+};
+
+template <typename T, typename U, typename... Ts>
+struct type_index_of<T, TypeList<U, Ts...>>
+	: std::integral_constant<size_t, 1 + type_index_of<T, TypeList<Ts...>>::value>
+{
+};
+
+/**
+ * The slot of the style type \p T in StyleTypes.
+ */
+template <typename T>
+constexpr size_t style_slot = type_index_of<T, StyleTypes>::value;
 
 /**
  * Container for multiple style types.
  *
- * This provides a non-template container for the (templated) StyleManager,
- * automatically constructing a new StyleManager when needed.
+ * This contains a StyleManager for every type in StyleTypes. Since the types
+ * are known at compile time, getting one is a direct access with no lookup.
  */
 struct MultiStyleManager
 {
-	// To store StyleManagers
-	struct TypeErased
-	{
-		virtual ~TypeErased() = default;
-		virtual void* get() = 0;
-		virtual const void* get() const = 0;
-	};
+	template <typename List>
+	struct Storage;
 
-	template <typename T>
-	struct TypePreserved
-		: public TypeErased
+	template <typename... Ts>
+	struct Storage<TypeList<Ts...>>
 	{
-		StyleManager<T> sm;
-	public:
-		virtual ~TypePreserved() = default;
-		virtual void* get() { return &sm; }
-		virtual const void* get() const { return &sm; }
+		using type = std::tuple<StyleManager<Ts>...>;
 	};
 
-	// type erased StyleManagers
-	std::map<std::type_index, std::unique_ptr<TypeErased>> stylemans;
+	typename Storage<StyleTypes>::type stylemans;
 public:
 	/**
-	 * Clear and construct (if needed) a StyleManager for type \p T.
+	 * Clear the StyleManager for type \p T, leaving only the default style.
 	 */
 	template <typename T>
 	StyleManager<T>& reset()
 	{
-		auto store = std::make_unique<TypePreserved<T>>();
-		auto* ref = static_cast<StyleManager<T>*>(store->get());
-		stylemans.emplace(typeid(T), std::move(store));
-		return *ref;
+		auto& sm = this->get<T>();
+		sm = StyleManager<T>();
+		return sm;
 	}
 
 	/**
-	 * Access a StyleManager for a specific type \p T, constructing it if
-	 * needed. This is similar to operator[] for std::map.
+	 * Access the StyleManager for a specific type \p T.
 	 */
 	template <typename T>
 	StyleManager<T>& get()
 	{
-		if(stylemans.count(typeid(T)) > 0) {
-			void* erased = stylemans.at(typeid(T))->get();
-			return *static_cast<StyleManager<T>*>(erased);
-		}
-		return this->reset<T>();
+		return std::get<style_slot<T>>(stylemans);
+	}
+
+	template <typename T>
+	const StyleManager<T>& get() const
+	{
+		return std::get<style_slot<T>>(stylemans);
+	}
+
+	/**
+	 * Call \p fn with every StyleManager, in slot order.
+	 */
+	template <typename Fn>
+	void for_each(Fn&& fn)
+	{
+		this->for_each_impl(fn, std::make_index_sequence<StyleTypes::size>());
+	}
+
+	template <typename Fn>
+	void for_each(Fn&& fn) const
+	{
+		this->for_each_impl(fn, std::make_index_sequence<StyleTypes::size>());
+	}
+
+	/**
+	 * Call \p fn with the StyleManager in slot \p slot, if it exists.
+	 */
+	template <typename Fn>
+	void visit(size_t slot, Fn&& fn)
+	{
+		size_t current = 0;
+		this->for_each([&] (auto& sm) {
+			if(current++ == slot) {
+				fn(sm);
+			}
+		});
+	}
+
+private:
+	template <typename Fn, size_t... Is>
+	void for_each_impl(Fn& fn, std::index_sequence<Is...>)
+	{
+		int expand[] = { 0, (fn(std::get<Is>(stylemans)), 0)... };
+		(void)expand;
+	}
+
+	template <typename Fn, size_t... Is>
+	void for_each_impl(Fn& fn, std::index_sequence<Is...>) const
+	{
+		int expand[] = { 0, (fn(std::get<Is>(stylemans)), 0)... };
+		(void)expand;
 	}
 };
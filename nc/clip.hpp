@@ -8,6 +8,8 @@
 #include "globals.hpp"
 #include "cursor.hpp"
 
+#include "../anchor.hpp"
+
 // like vim registers, for copying and pasting
 /**
  * A container for a single Drawable, with operations for a clipboard. Offset
@@ -32,6 +34,7 @@ public:
 
 		contents = std::move(es.elements[id]);
 		es.elements.erase(es.elements.begin() + id);
+		record(Change::erase(id), Change::insert(id, *contents));
 		x = cur.x;
 		y = cur.y;
 	}
@@ -58,8 +61,12 @@ public:
 	void paste_here()
 	{
 		if(contents) {
-			es.elements.emplace_back(contents->clone());
+			auto pasted = contents->clone();
+			rekey_pasted(*pasted, es);
+			es.elements.push_back(std::move(pasted));
 			es.elements.back()->shift(cur.x - x, cur.y - y);
+			int id = es.elements.size() - 1;
+			record(Change::insert(id, *es.elements.back()), Change::erase(id));
 		}
 	}
 };
@@ -10,7 +10,7 @@
 #include "../canvas.hpp"
 #include "../base.hpp"
 
-#include <set>
+#include <vector>
 
 /**
  * The current position of the cursor. Modifying this will move the cursor at
@@ -28,15 +28,15 @@ extern point region;
  * Get the index of the element under the cursor, returning -1 if nothing.
  *
  * This is done by determining the topmost element being drawn at the cursor
- * position.
+ * position (see Document::id_at).
  */
 int idhere();
 
 /**
- * Get all elements that are in a rectange from (\p x1, \p y1) to (\p x2, \p
- * y2) inclusive. They do not have to be in a specific order (e.g. x1 can be
- * greater than x2).
+ * Get all elements (sorted) that are in a rectange from (\p x1, \p y1) to
+ * (\p x2, \p y2) inclusive. The corners do not have to be in a specific order
+ * (e.g. x1 can be greater than x2).
  *
- * Similar to idhere(), this determines the elements by what is drawm.
+ * Similar to idhere(), this determines the elements by what is drawn.
  */
-std::set<int> id_in_region(int x1, int y1, int x2, int y2);
+std::vector<int> id_in_region(int x1, int y1, int x2, int y2);
@@ -9,18 +9,53 @@
 #include "renderer.hpp"
 
 #include "../base.hpp"
+#include "../journal.hpp"
 
 #include <ncurses.h>
+#include <cstdio>
+#include <cstring>
 
-int main()
+/**
+ * Draw the document onto the whole screen with \p renderer.
+ */
+template <typename Glyph>
+static void draw_screen(CursesRenderer<Glyph>& renderer)
+{
+	renderer.reset(0, 0, region.x - 1, region.y - 1);
+	doc.draw(renderer);
+	renderer.present();
+}
+
+int main(int argc, char** argv)
 {
 	cur.x = 0; cur.y = 1;
 
-	CursesSetup cs;
-	CursesRenderer crender;
+	// -u draws lines with Unicode box drawing characters
+	int arg = 1;
+	bool unicode = false;
+	if(arg < argc && std::strcmp(argv[arg], "-u") == 0) {
+		unicode = true;
+		++arg;
+	}
+	if(arg < argc) {
+		docpath = argv[arg];
+	}
+
+	// a new file if it doesn't exist, including unsaved changes if it does
+	std::uint32_t sequence = 0;
+	if(!recover_document(docpath, doc, sequence)) {
+		std::fprintf(stderr, "Cannot read %s\n", docpath.c_str());
+		return 1;
+	}
+	// if this fails, editing still works, but the status line warns that
+	// nothing is being saved
+	journal.open(docpath, sequence);
 
-	init_pair(10, COLOR_BLACK, COLOR_GREEN);
-	init_pair(11, COLOR_WHITE, COLOR_RED);
+	CursesSetup cs;
+	CursesRenderer<char> crender;
+	CursesRenderer<char32_t> wrender;
+	crender.styles = &msm;
+	wrender.styles = &msm;
 
 	// 0: Universal
 	ls.layers.emplace_back(std::make_unique<Universal>());
@@ -36,7 +71,11 @@ int main()
 		ls.event(input);
 		ls.frame();
 
-		es.draw(crender);
+		if(unicode) {
+			draw_screen(wrender);
+		} else {
+			draw_screen(crender);
+		}
 
 		const char* mode_name = "???";
 
@@ -64,15 +103,19 @@ int main()
 			break;
 		}
 
-		attron(COLOR_PAIR(10));
+		attron(COLOR_PAIR(StatusPair));
 		mvhline(0, 0, ' ', region.x);
-		mvprintw(0, 1, "%d/%d -- %s -- '?' for help", 1 + idhere(), es.elements.size(), mode_name);
+		const DocumentLayer& layer = doc.active_layer();
+		mvprintw(0, 1, "%d/%d -- %s -- %s (%d/%d)%s%s%s -- '?' for help", 1 + idhere(), static_cast<int>(es.elements.size()),
+			mode_name, layer.name.c_str(), static_cast<int>(doc.active) + 1, static_cast<int>(doc.layers.size()),
+			layer.visible ? "" : " hidden", layer.locked ? " locked" : "",
+			journal.is_open() ? "" : " -- NOT SAVING");
 
 		auto clamp = [] (int val, int low, int high) { return val < low ? low : val > high ? high : val; };
 		cur.y = clamp(cur.y, 1, region.y - 1);
 		cur.x = clamp(cur.x, 0, region.x - 1);
 
-		attroff(COLOR_PAIR(10));
+		attroff(COLOR_PAIR(StatusPair));
 
 		move(cur.y, cur.x);
 		wnoutrefresh(stdscr);
@@ -86,4 +129,6 @@ int main()
 		}
 	}
 
+	journal.close();
+
 }
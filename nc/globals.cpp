@@ -1,5 +1,23 @@
 #include "globals.hpp"
 
-MultiStyleManager msm;
-ElementStack es;
+Document doc;
+MultiStyleManager& msm = doc.msm;
+ElementStack& es = doc.es;
 LayerStack ls;
+std::string docpath = "untitled.agd";
+Journal journal;
+History history;
+
+void record(Change change, Change undo)
+{
+	journal.append(change);
+	history.record(std::move(change), std::move(undo));
+}
+
+void record(std::vector<Change> changes, std::vector<Change> undo)
+{
+	for(auto& change : changes) {
+		journal.append(change);
+	}
+	history.record(std::move(changes), std::move(undo));
+}
@@ -9,23 +9,71 @@
 
 #include "layer.hpp"
 
+#include "../document.hpp"
 #include "../drawable.hpp"
+#include "../history.hpp"
+#include "../journal.hpp"
 #include "../multistyle.hpp"
 
+#include <string>
+
+/**
+ * The colour pairs used. Pairs 1 to 8 are the pens' colours (see Pen), on
+ * the default background.
+ */
+enum ColourPair : short
+{
+	StatusPair = 10, ///< The status line.
+	AlertPair  = 11, ///< Errors, and the visual mode selection.
+};
+
+/**
+ * The document being edited.
+ */
+extern Document doc;
+
 /**
- * Manager for all styles across the program. This holds the available styles,
- * as well as provides them to new elements.
+ * Manager for all styles across the program (those of doc). This holds the
+ * available styles, as well as provides them to new elements.
  */
-extern MultiStyleManager msm;
+extern MultiStyleManager& msm;
 
 /**
- * The main stack of all elements. This may contain lower ElementStacks
- * (groups), but those may not contain any ElementStack.
+ * The main stack of all elements (those of doc). This may contain lower
+ * ElementStacks (groups), but those may not contain any ElementStack.
  */
-extern ElementStack es;
+extern ElementStack& es;
 
 /**
  * Layer of UI interactions. The first layer is the Universal layer, then the
  * mode, and after than any popup dialogs.
  */
 extern LayerStack ls;
+
+/**
+ * The file the document is saved to.
+ */
+extern std::string docpath;
+
+/**
+ * The journal of docpath. All changes to es and msm need to be appended to it
+ * once made, so they are saved.
+ */
+extern Journal journal;
+
+/**
+ * The undo/redo history of the document.
+ */
+extern History history;
+
+/**
+ * Record \p change, which has been made to the document and is reversed by
+ * \p undo, appending it to the journal and the history.
+ */
+void record(Change change, Change undo);
+
+/**
+ * Record a step made of several changes, which are reversed by \p undo.
+ */
+void record(std::vector<Change> changes, std::vector<Change> undo);
+
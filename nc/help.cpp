@@ -35,10 +35,12 @@ bindings usable almost everywhere.
         j       Move cursor down
         k       Move cursor up
         l       Move cursor right
-        H       Scroll screen to the left (moving everything right)
+        H       Scroll screen to the left (moving everything right, on every
+                  layer)
         J       Scroll screen down (moving everything up)
         K       Scroll screen up (moving everything down)
-        L       Scroll screen to the right (moving everything left)
+        L       Scroll screen to the right (moving everything left). Scrolling
+                  several times in a row is undone all at once
         q       Quit (even through other modes)
 
 ========== Normal Mode =========================================================
@@ -48,20 +50,49 @@ bindings usable almost everywhere.
 
         x       Remove the top element under the cursor (into the register)
         p       Paste the item in the register, keeping the offset of the cursor
+        w       Write (save) the document to the file given when starting, or
+                  untitled.agd if there wasn't one. Changes are also saved
+                  automatically as they are made, to a .journal file next to
+                  it, which is merged into the document regularly. If that
+                  can't be written, the status line shows NOT SAVING
+        r       Read a text file (whose path is typed in, then ENTER) into a
+                  text block at the cursor, all at once
+        R       Read a text file like r, but recognize the boxes and arrows
+                  drawn in it (using the current styles), so they can be
+                  edited like the ones drawn here
+        u       Undo the last change
+        ^R      Redo the last undone change
         v       Enter visual (block) mode
         b       Enter box mode
-        i       Enter insert mode
+        i       Enter insert mode, editing the text under the cursor if any
         a       Enter arrow mode
         m       Enter move mode (with element under cursor)
         s       Open style pop-up for boxes
         S       Open style pop-up for arrows
         <       Lower item below cursor by one level
         >       Raise item below cursor by one level
+        n       Add a new layer above the current one (whose name is typed
+                  in, then ENTER), and switch to it
+        [       Switch to the layer below
+        ]       Switch to the layer above
+        z       Hide or show the current layer
+        Z       Lock or unlock the current layer
+
+========== Layers ==============================================================
+  A document is drawn as a stack of named layers (e.g. a background, and
+  annotations over it). Only the current layer, shown in the status line, is
+  edited: the elements of the others can't be selected or changed, and they
+  are drawn from a cache, so editing stays fast however much is on them.
+
+  A locked layer can't be edited at all (not even by undoing), while a hidden
+  one isn't drawn (or exported), and its elements can't be picked. Switching
+  layers and changing these are undone like any other change.
 
 ========== Move Mode ===========================================================
   This mode allows you to move elements around (without modifying them). The
   element moved is the one under the cursor when this mode was started. If
-  nothing is under the cursor, this returns to normal mode.
+  nothing is under the cursor, this returns to normal mode. Moving a box also
+  moves the ends of the arrows anchored to it.
 
         m       Exit move mode, returning to normal mode
         h       Move element left
@@ -73,7 +104,7 @@ bindings usable almost everywhere.
   Visual mode allows you to select elements in a rectangular region and perform
   operations on multiple elements. Notably, you can group them, allowing you
   to act as if several elements are one. Every element that the selection
-  touches is considered part of the selection.
+  touches is considered part of the selection, and is highlighted in full.
 
         v       Exit visual mode and return to normal mode
         o       Go to Other end of box, as if the current cursor position was
@@ -106,15 +137,23 @@ expanding or contracting it.
 
 ========== Insert Mode =========================================================
   Plain text can be inserted while in Insert mode. While in this mode, anything
-  you type will be inserted as text. You can exit with escape.
+  you type will be inserted as text at the cursor. Entering Insert mode over
+  existing text edits it, otherwise a new text block is started. The cursor can
+  be moved within the text with the arrow keys. You can exit with escape.
 
-        ESC     Finish text block, returning to normal mode
+        BACKSPACE  Delete the character before the cursor
+        DELETE     Delete the character under the cursor
+        ESC        Finish text block, returning to normal mode
 
 ========== Arrow Mode ==========================================================
   Arrow mode allows you to draw arrows. Arrows are represented as a sequence of
   checkpoints/marks (which the arrow must pass through), and the orientation
   between them. This allows you to make arrows of any kind.
 
+  An arrow starting or ending on (or just beside) the border of a box is
+  anchored to it, so it stays attached when the box is moved. Its first or
+  last segment is turned to meet that side of the box straight on.
+
         x       Delete the current arrow and return to normal mode
         a       Create a new checkpoint. Doing this twice at a spot finishes
                   the arrow
@@ -139,6 +178,10 @@ expanding or contracting it.
   After pressing the placeholder, the corresponding component is temporarily set to '#'
   both in the style dialog and for all elements.
 
+  The part on the right of the middle row is the colour of the element: one of
+  k, r, g, y, b, m, c and w (black, red, green, yellow, blue, magenta, cyan and
+  white), or the same in upper case for bold. Anything else is the default.
+
         q       Close the style pop-up
         +       Duplicate the current style
         [       Switch to the previous style
@@ -152,7 +195,6 @@ Asciigram is in development, so there are several features which need to be
 implemented, some of which are integral to its use.
  - Completing the help pop-up
  - Exporting to ASCII
- - Saving
  - Arrow styling
  - Template elements
  - Container elements (e.g. text in a diamond)
@@ -27,7 +27,10 @@
 #include "../item/text.hpp"
 #include "../item/arrow.hpp"
 
-#include "../asciirender.hpp"
+#include "../anchor.hpp"
+#include "../export.hpp"
+#include "../import.hpp"
+#include "../recognize.hpp"
 #include "../sysclip.hpp"
 
 #include <ncurses.h>
@@ -68,6 +71,67 @@ extern Mode mode;
  */
 void setmode(Mode m);
 
+/**
+ * Record the insertion of \p elem, if it is still at the top of es.
+ *
+ * Modes which add an element and then modify it use this when they end, so
+ * that only the finished element is logged.
+ */
+inline void log_added(const Drawable* elem)
+{
+	if(!es.elements.empty() && es.elements.back().get() == elem) {
+		int id = es.elements.size() - 1;
+		record(Change::insert(id, *elem), Change::erase(id));
+	}
+}
+
+/**
+ * Edit the layer at index \p layer (which must exist) of doc, recording it so
+ * that later changes are applied to that layer when replayed.
+ */
+inline void select_layer(size_t layer)
+{
+	int old = doc.active;
+	if(static_cast<int>(layer) != old) {
+		doc.select_layer(layer);
+		record(Change::layer_select(layer), Change::layer_select(old));
+	}
+}
+
+/**
+ * Set the LayerFlags of the active layer to \p flags.
+ */
+inline void set_layer_flags(std::uint8_t flags)
+{
+	std::uint8_t old = doc.active_layer().flags();
+	doc.active_layer().set_flags(flags);
+	record(Change::layer_state(doc.active, flags), Change::layer_state(doc.active, old));
+}
+
+/**
+ * Move everything (on every layer) by \p x and \p y, along with the cursor,
+ * so it stays over the same spot.
+ */
+inline void scroll_all(int x, int y)
+{
+	doc.shift_all(x, y);
+	record(Change::shift_all(x, y), Change::shift_all(-x, -y));
+	cur.x += x;
+	cur.y += y;
+}
+
+/**
+ * Return if the elements of the active layer can't be edited, beeping if so.
+ */
+inline bool layer_locked()
+{
+	if(doc.active_layer().locked) {
+		beep();
+		return true;
+	}
+	return false;
+}
+
 /**
  * A pop-up for changing the style, templated on the style type.
  *
@@ -101,7 +165,7 @@ public:
 		, part_id(-1)
 		, save_part(0)
 	{
-		auto max = msm.get<T>().get_display_range();
+		constexpr auto max = style_display_range<T>();
 		win = newwin(max.y + 4, std::max(17, max.x * 2 + 11), 10, 10); // 17 for title
 	}
 
@@ -113,10 +177,10 @@ public:
 
 	virtual bool event(int ev) override
 	{
-		auto display_points = msm.get<T>().get_display_points();
+		auto& sm = msm.get<T>();
 
 		if(part_id != -1) {
-			char* part = display_points[part_id].first;
+			char* part = &(sm.first_style().*style_parts<T>[part_id].member);
 			if(isprint(ev)) {
 				*part = ev;
 			} else if(ev == KEY_BACKSPACE) {
@@ -124,33 +188,45 @@ public:
 			} else {
 				*part = save_part;
 			}
+			sm.modified_first();
+			if(*part != save_part) {
+				record(Change::style_part(sm.get_first(), part_id, *part),
+					Change::style_part(sm.get_first(), part_id, save_part));
+			}
 			part_id = -1;
 			return false;
 		}
 
-		std::string ph = placeholders;
-		auto idx = ph.find(ev);
-		if(idx != std::string::npos && idx < display_points.size()) {
-			part_id = idx;
-			char* part = display_points[part_id].first;
-			save_part = *part;
-			*part = '#';
-			return false;
+		for(size_t idx = 0; idx < style_parts<T>.size() && placeholders[idx] != '\0'; ++idx) {
+			if(placeholders[idx] == ev) {
+				part_id = idx;
+				char* part = &(sm.first_style().*style_parts<T>[part_id].member);
+				save_part = *part;
+				*part = '#';
+				sm.modified_first();
+				return false;
+			}
 		}
 
+		auto old_order = Change::style_order(sm.styles);
 		switch(ev) {
 		case 'q':
 		case '\033':
 			ls.layers.pop_back();
 			break;
 		case '+':
-			msm.get<T>().duplicate_first();
+			sm.duplicate_first();
+			// the style is never removed, so redo only restores the order
+			journal.append(Change::style_add<T>());
+			history.record(Change::style_order(sm.styles), std::move(old_order));
 			break;
 		case ']':
-			msm.get<T>().unshift();
+			sm.unshift();
+			record(Change::style_rotate<T>(1), std::move(old_order));
 			break;
 		case '[':
-			msm.get<T>().shift();
+			sm.shift();
+			record(Change::style_rotate<T>(-1), std::move(old_order));
 			break;
 		}
 		return false;
@@ -161,16 +237,18 @@ public:
 		werase(win);
 		box(win, 0, 0); // standard border
 
-		auto max = msm.get<T>().get_display_range();
+		constexpr auto max = style_display_range<T>();
+		const T& style = msm.get<T>().first_style();
 
 		int idx = 0;
-		for(auto& part : msm.get<T>().get_display_points()) {
+		for(auto& part : style_parts<T>) {
 			// placeholder
-			mvwaddch(win, part.second.y + 1, part.second.x + 2, placeholders[idx]);
+			mvwaddch(win, part.pos.y + 1, part.pos.x + 2, placeholders[idx]);
 
 			// existing component
-			if(*part.first != '\0') {
-				mvwaddch(win, part.second.y + 1, part.second.x + max.x + 7, *part.first);
+			char current = style.*part.member;
+			if(current != '\0') {
+				mvwaddch(win, part.pos.y + 1, part.pos.x + max.x + 7, current);
 			}
 
 			++idx;
@@ -184,6 +262,171 @@ public:
 	}
 }; // }}}
 
+/**
+ * A prompt for the path of a text file, which is imported at the cursor.
+ *
+ * The file is either added as a single Text, or recognized as ASCII art (see
+ * recognize_art()). Either way, it is added in one event (and so one redraw),
+ * rather than being typed in through InsertMode.
+ */
+struct ImportLayer // {{{
+	: public Layer
+{
+	WINDOW* win;
+	bool art; // recognize the elements drawn
+	std::string path;
+	std::string error; // of the last attempt, if it failed
+public:
+	explicit ImportLayer(bool art)
+		: win(newwin(1, region.x, region.y - 1, 0)), art(art)
+	{
+	}
+
+	/**
+	 * Import the file at path, recording it as one step. Returns false if
+	 * it can't be read.
+	 */
+	bool import()
+	{
+		ElementStack found;
+		if(art) {
+			if(!import_art(path, cur, msm, found)) {
+				return false;
+			}
+		} else if(auto text = import_text(path, cur.x, cur.y)) {
+			found.elements.push_back(std::move(text));
+		} else {
+			return false;
+		}
+
+		std::vector<Change> changes;
+		std::vector<int> ids;
+		for(auto& elem : found.elements) {
+			ids.push_back(es.elements.size());
+			changes.push_back(Change::insert(ids.back(), *elem));
+			es.elements.push_back(std::move(elem));
+		}
+		std::vector<Change> undo;
+		undo.push_back(Change::erase_many(std::move(ids)));
+		record(std::move(changes), std::move(undo));
+		return true;
+	}
+
+	~ImportLayer()
+	{
+		delwin(win);
+	}
+
+	virtual bool event(int val) override
+	{
+		if(isprint(val)) {
+			path.push_back(val);
+			error.clear();
+		} else switch(val) {
+		case KEY_BACKSPACE:
+			if(!path.empty()) {
+				path.pop_back();
+			}
+			error.clear();
+			break;
+		case '\033':
+			ls.layers.pop_back(); // close prompt
+			break;
+		case '\r': case '\n':
+			if(this->import()) {
+				ls.layers.pop_back();
+			} else {
+				error = "Cannot read " + path;
+			}
+			break;
+		}
+		return false;
+	}
+
+	virtual void post() override
+	{
+		werase(win);
+		if(error.empty()) {
+			mvwprintw(win, 0, 0, "%s: %s", art ? "Import art" : "Import", path.c_str());
+		} else {
+			wattron(win, COLOR_PAIR(AlertPair));
+			mvwaddstr(win, 0, 0, error.c_str());
+			wattroff(win, COLOR_PAIR(AlertPair));
+		}
+		wnoutrefresh(win);
+	}
+}; // }}}
+
+/**
+ * A prompt for the name of a new drawing layer, which is added above the
+ * active one and then edited.
+ */
+struct NewLayerLayer // {{{
+	: public Layer
+{
+	WINDOW* win;
+	std::string name;
+public:
+	NewLayerLayer()
+		: win(newwin(1, region.x, region.y - 1, 0))
+	{
+	}
+
+	~NewLayerLayer()
+	{
+		delwin(win);
+	}
+
+	/**
+	 * Add the layer, recording it as one step with selecting it.
+	 */
+	void add()
+	{
+		int old = doc.active;
+		int at = old + 1;
+		doc.insert_layer(at, name);
+		doc.select_layer(at);
+
+		std::vector<Change> changes;
+		changes.push_back(Change::layer_add(at, name));
+		changes.push_back(Change::layer_select(at));
+		std::vector<Change> undo;
+		undo.push_back(Change::layer_select(old));
+		undo.push_back(Change::layer_erase(at));
+		record(std::move(changes), std::move(undo));
+	}
+
+	virtual bool event(int val) override
+	{
+		if(isprint(val)) {
+			name.push_back(val);
+		} else switch(val) {
+		case KEY_BACKSPACE:
+			if(!name.empty()) {
+				name.pop_back();
+			}
+			break;
+		case '\033':
+			ls.layers.pop_back(); // close prompt
+			break;
+		case '\r': case '\n':
+			if(!name.empty()) {
+				this->add();
+			}
+			ls.layers.pop_back();
+			break;
+		}
+		return false;
+	}
+
+	virtual void post() override
+	{
+		werase(win);
+		mvwprintw(win, 0, 0, "New layer: %s", name.c_str());
+		wnoutrefresh(win);
+	}
+}; // }}}
+
 /**
  * Universally available actions, common to all modes.
  *
@@ -220,20 +463,16 @@ struct Universal // {{{
 			++cur.x;
 			break;
 		case 'H':
-			es.shift(1, 0);
-			++cur.x;
+			scroll_all(1, 0);
 			break;
 		case 'J':
-			es.shift(0, -1);
-			--cur.y;
+			scroll_all(0, -1);
 			break;
 		case 'K':
-			es.shift(0, 1);
-			++cur.y;
+			scroll_all(0, 1);
 			break;
 		case 'L':
-			es.shift(-1, 0);
-			--cur.x;
+			scroll_all(-1, 0);
 			break;
 		case 'q':
 			setmode(Mode::Quit);
@@ -256,8 +495,25 @@ struct Universal // {{{
 struct NormalMode // {{{
 	: public Layer
 {
+	/**
+	 * Return if \p key changes the elements of the active layer.
+	 */
+	static bool edits(int key)
+	{
+		switch(key) {
+		case 'x': case 'p': case 'r': case 'R': case 'b': case 'i': case 'a': case 'm': case '<': case '>':
+			return true;
+		default:
+			return false;
+		}
+	}
+
 	virtual bool event(int val) override
 	{
+		if(edits(val) && layer_locked()) {
+			return false;
+		}
+
 		int here = idhere();
 		switch(val) {
 		case 'x':
@@ -269,6 +525,35 @@ struct NormalMode // {{{
 		case 'p':
 			clip.paste_here();
 			break;
+		case 'w':
+			journal.request_compact();
+			break;
+		case 'r':
+		case 'R':
+			ls.layers.emplace_back(std::make_unique<ImportLayer>(val == 'R'));
+			break;
+		case 'u':
+		case '\x12': // ^R
+			{
+				auto next = history.next(val == 'u');
+				bool edits = next && std::any_of(next->begin(), next->end(), [] (const Change& change) {
+					return change.edits_elements();
+				});
+				if(edits && layer_locked()) {
+					break;
+				}
+
+				// even if only part of the step was applied, journal that part
+				bool complete = false;
+				if(auto changes = (val == 'u' ? history.undo(doc, &complete) : history.redo(doc, &complete))) {
+					for(auto& change : *changes) {
+						journal.append(change);
+					}
+				}
+				if(!complete) {
+					beep();
+				}
+			} break;
 		case 'v':
 			setmode(Mode::Visual);
 			break;
@@ -295,13 +580,34 @@ struct NormalMode // {{{
 		case '<': // lower
 			if(here > 0) {
 				std::swap(es.elements[here], es.elements[here - 1]);
+				record(Change::swap(here, here - 1), Change::swap(here, here - 1));
 			}
 			break;
 		case '>': // higher
 			if(here != -1 && here < static_cast<int>(es.elements.size()) - 1) {
 				std::swap(es.elements[here], es.elements[here + 1]);
+				record(Change::swap(here, here + 1), Change::swap(here, here + 1));
+			}
+			break;
+		case 'n':
+			ls.layers.emplace_back(std::make_unique<NewLayerLayer>());
+			break;
+		case '[': // layer below
+			if(doc.active > 0) {
+				select_layer(doc.active - 1);
 			}
 			break;
+		case ']': // layer above
+			if(doc.active + 1 < doc.layers.size()) {
+				select_layer(doc.active + 1);
+			}
+			break;
+		case 'z':
+			set_layer_flags(doc.active_layer().flags() ^ LayerHidden);
+			break;
+		case 'Z':
+			set_layer_flags(doc.active_layer().flags() ^ LayerLocked);
+			break;
 		default:
 			return true;
 		}
@@ -309,6 +615,46 @@ struct NormalMode // {{{
 	}
 }; // }}}
 
+/**
+ * Highlight every cell drawn on the screen (below the status line) as
+ * selected, leaving the characters as they are.
+ */
+struct SelectionHighlighter
+	: public Canvas
+{
+public:
+	SelectionHighlighter()
+	{
+		this->set_visible(0, 1, region.x - 1, region.y - 1);
+	}
+
+	virtual void impl_set(char /* fill */, int x, int y) override
+	{
+		this->impl_lineh(0, x, y, x);
+	}
+
+	virtual void impl_lineh(char /* fill */, int x1, int y, int x2) override
+	{
+		x1 = std::max(x1, visible_min.x);
+		x2 = std::min(x2, visible_max.x);
+		if(visible_min.y <= y && y <= visible_max.y && x1 <= x2) {
+			mvchgat(y, x1, x2 - x1 + 1, A_REVERSE, AlertPair, nullptr);
+		}
+	}
+
+	virtual void impl_fill(char /* fill */, int x1, int y1, int x2, int y2) override
+	{
+		for(int y = std::max(y1, visible_min.y); y <= std::min(y2, visible_max.y); ++y) {
+			this->impl_lineh(0, x1, y, x2);
+		}
+	}
+
+	virtual void impl_direct(strview str, int x, int y) override
+	{
+		this->impl_lineh(0, x, y, x + static_cast<int>(str.size()) - 1);
+	}
+};
+
 /**
  * Block selection mode, for working with multiple elements.
  *
@@ -318,63 +664,74 @@ struct VisualMode // {{{
 	: public Layer
 {
 	point p1, p2;
+
+	RegionSelection selection; // as of the change version
+	std::uint32_t version;
+	point scrolled = { 0, 0 }; // how far everything has moved since the selection was made
 public:
 	VisualMode()
-		: p1(cur), p2(cur)
+		: p1(cur), p2(cur), version(journal.last_sequence())
 	{
+		doc.select_region(selection, p1, p2);
 	}
 
-	void shift(int x, int y) {
+	/**
+	 * Scroll, moving the rectangle along with the elements. Which ones are
+	 * selected doesn't change, so the selection is kept, as if the
+	 * rectangle hadn't moved.
+	 */
+	void scroll_with(int x, int y) {
+		scroll_all(x, y);
 		p1.x += x;
 		p1.y += y;
 
 		p2.x += x;
 		p2.y += y;
+
+		scrolled.x += x;
+		scrolled.y += y;
+		version = journal.last_sequence();
+	}
+
+	/**
+	 * Bring the selection up to date with the rectangle, only checking
+	 * the elements near where it has changed, unless the elements have.
+	 */
+	void reselect()
+	{
+		std::uint32_t now = journal.last_sequence();
+		if(now != version || selection.selected.size() != es.elements.size()) {
+			scrolled = { 0, 0 };
+			doc.select_region(selection, p1, p2);
+		} else {
+			point from{ p1.x - scrolled.x, p1.y - scrolled.y };
+			point to{ p2.x - scrolled.x, p2.y - scrolled.y };
+			doc.reselect_region(selection, from, to);
+		}
+		version = now;
 	}
 
 	virtual bool event(int val) override
 	{
-		auto ids = id_in_region(p1.x, p1.y, p2.x, p2.y);
-
-		auto make_group = [&] {
-			ElementStack group;
-			int offset = 0;
-			for(auto& id : ids) { // ids are sorted
-				auto it = es.elements.begin() + id + offset;
-				if(auto* old_stack = dynamic_cast<ElementStack*>(it->get())) {
-					// unpack the stack
-					for(auto& elem : old_stack->elements) {
-						group.elements.push_back(std::move(elem));
-					}
-				} else {
-					group.elements.push_back(std::move(*it));
-				}
-				es.elements.erase(it);
-				--offset;
-			}
-			ids.clear(); // ids are invalid
-			return group;
-		};
+		this->reselect();
+		auto ids = selection.selected.ids();
 
-		auto copy_group = [&] {
-			ElementStack group;
-			for(auto& id : ids) { // ids are sorted
-				auto it = es.elements.begin() + id;
-				if(auto* old_stack = dynamic_cast<ElementStack*>(it->get())) {
-					// unpack the stack
-					for(auto& elem : old_stack->elements) {
-						group.elements.push_back(elem->clone());
-					}
-				} else {
-					group.elements.push_back((*it)->clone());
-				}
+		// restores the elements at ids, once they are removed
+		auto restore_ids = [&] {
+			std::vector<Change> undo;
+			for(int id : ids) {
+				undo.push_back(Change::insert(id, *es.elements[id]));
 			}
-			return group;
+			return undo;
 		};
 
 		// not a visual operation - propagate
 		bool more = false;
 
+		if((val == 'g' || val == 'x') && layer_locked()) {
+			return false;
+		}
+
 		switch(val) {
 		case 'v':
 			break;
@@ -385,22 +742,38 @@ public:
 			std::swap(p1.x, p2.y);
 			return false;
 		case 'g':
-			es.elements.push_back(std::make_unique<ElementStack>(make_group()));
-			break;
+			{
+				std::vector<Change> undo;
+				undo.push_back(Change::erase(es.elements.size() - ids.size())); // the group
+				for(auto& change : restore_ids()) {
+					undo.push_back(std::move(change));
+				}
+
+				es.elements.push_back(std::make_unique<ElementStack>(es.extract(ids)));
+				es.back_as<ElementStack>()->use_cache = true;
+				std::vector<Change> changes;
+				changes.push_back(Change::group(std::move(ids)));
+				record(std::move(changes), std::move(undo));
+			} break;
 		case 'y':
-			clip.contents = std::make_unique<ElementStack>(copy_group());
+			clip.contents = std::make_unique<ElementStack>(es.copy_of(ids));
 			clip.x = cur.x;
 			clip.y = cur.y;
 			break;
 		case 'c':
 			{
-				AsciiRenderer ar{p1.x, p1.y, p2.x, p2.y};
-				es.draw(ar);
-				copy_to_sysclip(ar.joined());
+				StringSink sink;
+				export_region(doc, p1, p2, sink);
+				copy_to_sysclip(sink.text);
 			} break;
 		case 'x':
-			make_group(); // destruct to kill
-			break;
+			{
+				auto undo = restore_ids();
+				es.extract(ids); // destruct to kill
+				std::vector<Change> changes;
+				changes.push_back(Change::erase_many(std::move(ids)));
+				record(std::move(changes), std::move(undo));
+			} break;
 		default:
 			more = true;
 		}
@@ -412,17 +785,17 @@ public:
 
 		switch(val) {
 		case 'H':
-			this->shift(1, 0);
-			break;
+			this->scroll_with(1, 0);
+			return false;
 		case 'J':
-			this->shift(0, -1);
-			break;
+			this->scroll_with(0, -1);
+			return false;
 		case 'K':
-			this->shift(0, 1);
-			break;
+			this->scroll_with(0, 1);
+			return false;
 		case 'L':
-			this->shift(-1, 0);
-			break;
+			this->scroll_with(-1, 0);
+			return false;
 		}
 		return true;
 	}
@@ -430,6 +803,7 @@ public:
 	virtual void frame() override
 	{
 		p2 = cur;
+		this->reselect();
 	}
 
 	virtual void post() override
@@ -440,7 +814,14 @@ public:
 		int width = max.x - min.x + 1;
 
 		for(int y = min.y; y <= max.y; ++y) {
-			mvchgat(y, min.x, width, WA_NORMAL, 11, nullptr);
+			mvchgat(y, min.x, width, WA_NORMAL, AlertPair, nullptr);
+		}
+
+		// the whole of each element selected, even outside the rectangle
+		SelectionHighlighter highlight;
+		highlight.styles = &msm;
+		for(int id : selection.selected.ids()) {
+			highlight.draw(*es.elements[id]);
 		}
 
 		// redo this manually, since this would break dialogs if moved after
@@ -451,15 +832,66 @@ public:
 
 /**
  * Move a particular element.
+ *
+ * Arrows anchored to the boxes being moved (see anchor.hpp) are found when
+ * starting, and only their anchored ends are moved along with the boxes.
  */
 struct MoveMode // {{{
 	: public Layer
 {
 	int id;
+	point moved; // logged when done, as one change
+	std::vector<std::uint32_t> keys; // of the boxes moved
+	std::vector<int> arrows; // anchored to the boxes moved
 public:
 	MoveMode()
-		: id(idhere())
+		: id(idhere()), moved(0, 0)
+	{
+		if(id != -1) {
+			for_each_box(*es.elements[id], [&] (const Box& box) {
+				if(box.key != 0) {
+					keys.push_back(box.key);
+				}
+			});
+			if(!keys.empty()) {
+				AnchorIndex anchors;
+				anchors.build(es);
+				arrows = anchors.anchored_to(*es.elements[id], id);
+			}
+		}
+	}
+
+	~MoveMode()
+	{
+		if(id != -1 && (moved.x != 0 || moved.y != 0)) {
+			std::vector<Change> changes, undo;
+			changes.push_back(Change::shift(id, moved.x, moved.y));
+			for(int arrow : arrows) {
+				changes.push_back(Change::replace(arrow, *es.elements[arrow]));
+
+				// only the anchored ends were moved, so move them back
+				auto before = es.elements[arrow]->clone();
+				for(auto key : keys) {
+					static_cast<Arrow&>(*before).follow(key, -moved.x, -moved.y);
+				}
+				undo.push_back(Change::replace(arrow, *before));
+			}
+			undo.push_back(Change::shift(id, -moved.x, -moved.y));
+			record(std::move(changes), std::move(undo));
+		}
+	}
+
+	void shift(int x, int y)
 	{
+		es.elements[id]->shift(x, y);
+		moved.x += x;
+		moved.y += y;
+
+		for(int arrow : arrows) {
+			for(auto key : keys) {
+				static_cast<Arrow&>(*es.elements[arrow]).follow(key, x, y);
+			}
+		}
 	}
 
 	virtual bool event(int val) override
@@ -468,19 +900,19 @@ public:
 			switch(val) {
 			case 'h':
 			case KEY_LEFT:
-				es.elements[id]->shift(-1, 0);
+				this->shift(-1, 0);
 				break;
 			case 'j':
 			case KEY_DOWN:
-				es.elements[id]->shift(0, 1);
+				this->shift(0, 1);
 				break;
 			case 'k':
 			case KEY_UP:
-				es.elements[id]->shift(0, -1);
+				this->shift(0, -1);
 				break;
 			case 'l':
 			case KEY_RIGHT:
-				es.elements[id]->shift(1, 0);
+				this->shift(1, 0);
 				break;
 			}
 		}
@@ -498,9 +930,17 @@ public:
 struct BoxMode // {{{
 	: public Layer
 {
+	Drawable* added; // to check it wasn't removed
+public:
 	BoxMode()
 	{
 		es.add<Box>(cur.x, cur.y, msm.get<BoxStyle>().get_first());
+		added = es.elements.back().get();
+	}
+
+	~BoxMode()
+	{
+		log_added(added);
 	}
 
 	virtual bool event(int val) override
@@ -509,6 +949,8 @@ struct BoxMode // {{{
 
 		switch(val) {
 		case 'x':
+			log_added(added); // it needs to exist before being removed
+			added = nullptr;
 			clip.remove_here();
 			setmode(Mode::Normal);
 			break;
@@ -540,52 +982,84 @@ struct BoxMode // {{{
 }; // }}}
 
 /**
- * Insert a block of (raw) text.
+ * Insert a block of (raw) text, or edit the text under the cursor.
+ *
+ * Text is inserted at the cursor, which can be moved anywhere within the block
+ * (it is moved to the nearest char if outside of it).
  */
 struct InsertMode // {{{
 	: public Layer
 {
+	int id; // of the text being edited
+	bool added = false; // rather than editing existing text
+	Rope original; // the content before editing (sharing its storage)
+public:
 	InsertMode()
 	{
-		// TODO: re-inherit and edit existing value
-		es.add<Text>(cur.x, cur.y);
+		int here = idhere();
+		if(here != -1 && dynamic_cast<Text*>(es.elements[here].get())) {
+			id = here;
+			original = this->text().content();
+		} else {
+			es.add<Text>(cur.x, cur.y);
+			id = es.elements.size() - 1;
+			added = true;
+		}
 	}
 
 	~InsertMode()
 	{
-		if(es.back_as<Text>()->string.empty()) {
-			es.elements.pop_back();
+		Text& edited = this->text();
+		if(added) {
+			if(edited.content().empty()) {
+				es.elements.pop_back();
+			} else {
+				log_added(&edited);
+			}
+			return;
+		}
+
+		// undoing only restores the content, leaving the text wherever it
+		// is now (e.g. if everything was shifted while editing)
+		auto before = edited.clone();
+		static_cast<Text&>(*before).rope = original;
+		if(edited.content().empty()) {
+			es.elements.erase(es.elements.begin() + id);
+			record(Change::erase(id), Change::insert(id, *before));
+		} else if(edited.content().root != original.root) {
+			record(Change::replace(id, edited), Change::replace(id, *before));
 		}
 	}
 
+	Text& text()
+	{
+		return static_cast<Text&>(*es.elements[id]);
+	}
+
 	virtual bool event(int val) override
 	{
-		Text& text = *es.back_as<Text>();
+		Text& text = this->text();
+		size_t offset = text.offset_at(cur.x, cur.y);
 
 		if(isprint(val)) {
-			text.string.push_back(val);
-			++cur.x;
+			char typed = val;
+			text.rope.insert(offset, strview(&typed, 1));
+			cur = text.position_of(offset + 1);
 		} else switch(val) {
 		case '\r': case '\n':
-			text.string.push_back('\n');
-			cur.x = text.x;
-			++cur.y;
+			text.rope.insert(offset, "\n");
+			cur = text.position_of(offset + 1);
 			break;
 		case KEY_BACKSPACE:
-			if(!text.string.empty()) {
-				auto back = text.string.back();
-				text.string.pop_back();
-				if(back == '\n') {
-					--cur.y;
-					cur.x = text.x;
-					for(auto it = text.string.rbegin(); it != text.string.rend() && *it != '\n'; ++it) {
-						++cur.x;
-					}
-				} else {
-					--cur.x;
-				}
+			if(offset > 0) {
+				text.rope.erase(offset - 1, 1);
+				cur = text.position_of(offset - 1);
 			}
 			break;
+		case KEY_DC:
+			text.rope.erase(offset, 1);
+			cur = text.position_of(offset);
+			break;
 		default:
 			return true;
 		}
@@ -599,10 +1073,66 @@ struct InsertMode // {{{
 struct ArrowMode // {{{
 	: public Layer
 {
+	Drawable* added; // to check it wasn't removed
+public:
 	ArrowMode()
 	{
 		es.add<Arrow>(cur.x, cur.y, msm.get<ArrowStyle>().get_first());
 		es.back_as<Arrow>()->add_point(cur.x, cur.y);
+		added = es.elements.back().get();
+	}
+
+	~ArrowMode()
+	{
+		if(!es.elements.empty() && es.elements.back().get() == added) {
+			this->finish();
+		}
+	}
+
+	/**
+	 * Anchor the ends of the arrow (at the top of es) to the boxes they're
+	 * on the side of, if any, giving the boxes keys if they have none, and
+	 * record the arrow being added along with the keys.
+	 */
+	void finish()
+	{
+		int id = es.elements.size() - 1;
+		Arrow& arrow = *es.back_as<Arrow>();
+
+		std::vector<Change> changes, undo;
+		std::uint32_t next_key = 0;
+		auto anchor = [&] (point end, bool is_start) {
+			int box_id = anchor_box_at(es, end, id);
+			if(box_id == -1) {
+				return;
+			}
+
+			Box& box = static_cast<Box&>(*es.elements[box_id]);
+			if(box.key == 0) {
+				if(next_key == 0) {
+					next_key = next_anchor_key(es);
+				}
+				undo.push_back(Change::replace(box_id, box));
+				box.key = next_key++;
+				changes.push_back(Change::replace(box_id, box));
+			}
+
+			point min{ std::min(box.x1, box.x2), std::min(box.y1, box.y2) };
+			point max{ std::max(box.x1, box.x2), std::max(box.y1, box.y2) };
+			if(is_start) {
+				arrow.anchor_start(box.key, min, max);
+			} else {
+				arrow.anchor_end(box.key, min, max);
+			}
+		};
+		if(!arrow.points.empty()) {
+			anchor(arrow.start, true);
+			anchor(arrow.points.back().first, false);
+		}
+
+		changes.push_back(Change::insert(id, arrow));
+		undo.insert(undo.begin(), Change::erase(id));
+		record(std::move(changes), std::move(undo));
 	}
 
 	virtual bool event(int val) override
@@ -616,11 +1146,15 @@ struct ArrowMode // {{{
 
 		switch(val) {
 		case 'x':
+			log_added(added); // it needs to exist before being removed
+			added = nullptr;
 			clip.remove_here();
 			setmode(Mode::Normal);
 			break;
 		case 'a':
 			if(second_last && cur.x == second_last->x && cur.y == second_last->y) {
+				// the last point was only following the cursor
+				arrow.points.pop_back();
 				setmode(Mode::Normal);
 			} else {
 				arrow.add_point(cur.x, cur.y);
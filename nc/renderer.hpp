@@ -6,9 +6,14 @@
  * portion of the program, such as rendering.
  */
 
-#include "../canvas.hpp"
+#include "globals.hpp"
+
+#include "../asciirender.hpp"
 #include "../sysclip.cpp"
 
+#include <clocale>
+#include <vector>
+
 #include <ncurses.h>
 
 /**
@@ -21,10 +26,19 @@ struct CursesSetup
 {
 	CursesSetup()
 	{
+		// for box drawing characters
+		setlocale(LC_ALL, "");
+
 		initscr();
 		start_color();
 		use_default_colors();
 
+		for(short colour = 0; colour < 8; ++colour) {
+			init_pair(colour + 1, colour, -1);
+		}
+		init_pair(StatusPair, COLOR_BLACK, COLOR_GREEN);
+		init_pair(AlertPair, COLOR_WHITE, COLOR_RED);
+
 		cbreak();
 		keypad(stdscr, true);
 		noecho();
@@ -38,33 +52,90 @@ struct CursesSetup
 	}
 };
 
+/**
+ * Get the curses attributes (without the colour pair) for \p pen.
+ */
+inline attr_t pen_attrs(Pen pen)
+{
+	return (pen & pen_bold) ? A_BOLD : A_NORMAL;
+}
+
+/**
+ * Get the colour pair for \p pen (0 for the default).
+ */
+inline short pen_pair(Pen pen)
+{
+	return pen & 0xF;
+}
+
 /**
  * NCurses rendering of elements.
  *
- * This is an implementation of a Canvas that uses the NCurses API to draw
- * elements.
+ * Elements are drawn into a buffer covering the screen (so lines are joined
+ * up as with any CellRenderer), which present() then writes out a row at a
+ * time, each cell with the colour of its pen. With Styled<char32_t> cells,
+ * lines are drawn with box drawing characters.
+ *
+ * Every row is written with a single call, with the attributes already in
+ * each cell (as a chtype or cchar_t), so colours cost nothing extra.
  */
+template <typename Glyph>
 struct CursesRenderer
-	: public Canvas
+	: public CellRenderer<Styled<Glyph>>
 {
+	std::vector<chtype> narrow; // a row being written, for ASCII
+	std::vector<cchar_t> wide; // a row being written, for Unicode
+	chtype pen_chtype[256]; // the attributes for each pen
 public:
-	virtual void impl_set(char fill, int x, int y) override
+	CursesRenderer()
+		: CellRenderer<Styled<Glyph>>(0, 0, 0, 0)
 	{
-		mvaddch(y, x, fill);
+		for(int pen = 0; pen < 256; ++pen) {
+			pen_chtype[pen] = pen_attrs(pen) | COLOR_PAIR(pen_pair(pen));
+		}
 	}
 
-	virtual void impl_linev(char fill, int x, int y1, int y2) override
-	{
-		mvvline(y1, x, fill, y2 - y1 + 1);
-	}
+	/**
+	 * Write everything drawn to the screen, with the top left of the buffer
+	 * at the top left of the screen.
+	 */
+	void present();
+};
 
-	virtual void impl_lineh(char fill, int x1, int y, int x2) override
-	{
-		mvhline(y, x1, fill, x2 - x1 + 1);
+template <>
+inline void CursesRenderer<char>::present()
+{
+	for(int row = 0; row < this->height(); ++row) {
+		int length = this->row_length(row);
+		if(length == 0) {
+			continue;
+		}
+
+		narrow.resize(length);
+		const Styled<char>* cells = this->row(row);
+		for(int idx = 0; idx < length; ++idx) {
+			narrow[idx] = static_cast<unsigned char>(cells[idx].glyph()) | pen_chtype[cells[idx].pen()];
+		}
+		mvaddchnstr(row, 0, narrow.data(), length);
 	}
+}
 
-	virtual void impl_direct(const std::string& str, int x, int y) override
-	{
-		mvprintw(y, x, "%s", str.c_str());
+template <>
+inline void CursesRenderer<char32_t>::present()
+{
+	for(int row = 0; row < this->height(); ++row) {
+		int length = this->row_length(row);
+		if(length == 0) {
+			continue;
+		}
+
+		wide.resize(length);
+		const Styled<char32_t>* cells = this->row(row);
+		for(int idx = 0; idx < length; ++idx) {
+			const wchar_t glyph[] = { static_cast<wchar_t>(cells[idx].glyph()), L'\0' };
+			Pen pen = cells[idx].pen();
+			setcchar(&wide[idx], glyph, pen_attrs(pen), pen_pair(pen), nullptr);
+		}
+		mvadd_wchnstr(row, 0, wide.data(), length);
 	}
-};
+}
@@ -0,0 +1,524 @@
+#include "recognize.hpp"
+
+#include "import.hpp"
+#include "mapping.hpp"
+
+#include "item/arrow.hpp"
+#include "item/box.hpp"
+#include "item/text.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// directions, as bits so that a cell's links fit in a mask
+enum : std::uint8_t
+{
+	North = 1,
+	East  = 2,
+	South = 4,
+	West  = 8,
+};
+
+static std::uint8_t opposite(std::uint8_t dir)
+{
+	return dir == North ? South : dir == South ? North : dir == East ? West : East;
+}
+
+static point step(point pos, std::uint8_t dir)
+{
+	switch(dir) {
+	case North: return { pos.x, pos.y - 1 };
+	case East:  return { pos.x + 1, pos.y };
+	case South: return { pos.x, pos.y + 1 };
+	default:    return { pos.x - 1, pos.y };
+	}
+}
+
+/**
+ * What each cell has been recognized as.
+ */
+enum class CellUse : std::uint8_t
+{
+	Free,   ///< Nothing yet (so Text, unless an arrow is found)
+	Box,    ///< A side or corner of a box
+	Shared, ///< A side of a box with an arrow drawn over it
+	Arrow,  ///< Part of an arrow
+};
+
+/**
+ * The text as a grid of cells, which is blank past the end of each row.
+ */
+struct Grid
+{
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	std::string text;
+	std::vector<size_t> starts; // of each row in text
+	std::vector<int> lengths; // of each row
+	std::vector<CellUse> use; // of each char of text
+public:
+	explicit Grid(std::string cleaned)
+		: text(std::move(cleaned)), use(text.size(), CellUse::Free)
+	{
+		size_t start = 0;
+		while(true) {
+			size_t end = text.find('\n', start);
+			starts.push_back(start);
+			lengths.push_back(static_cast<int>((end == std::string::npos ? text.size() : end) - start));
+			if(end == std::string::npos) {
+				break;
+			}
+			start = end + 1;
+		}
+	}
+
+	int rows() const
+	{
+		return static_cast<int>(starts.size());
+	}
+
+	/**
+	 * Get the index in text of the cell (\p x, \p y), or npos if it is
+	 * blank because it's outside of the text.
+	 */
+	size_t index(int x, int y) const
+	{
+		if(y < 0 || y >= this->rows() || x < 0 || x >= lengths[y]) {
+			return npos;
+		}
+		return starts[y] + x;
+	}
+
+	char at(int x, int y) const
+	{
+		size_t idx = this->index(x, y);
+		return idx == npos ? ' ' : text[idx];
+	}
+
+	/**
+	 * Return if the cell (\p x, \p y) is \p c and hasn't been used.
+	 */
+	bool free_is(int x, int y, char c) const
+	{
+		size_t idx = this->index(x, y);
+		return idx != npos && text[idx] == c && use[idx] == CellUse::Free;
+	}
+};
+
+constexpr size_t Grid::npos;
+
+/**
+ * The roles of a char in any of the arrow styles.
+ */
+struct Glyph
+{
+	std::uint8_t points = 0; // directions it connects to
+	bool line = false; // a side, which connects as long as its neighbour does
+	bool corner = false;
+	bool head = false;
+};
+
+using GlyphTable = std::array<Glyph, 256>;
+
+static GlyphTable arrow_glyphs(const MultiStyleManager& msm)
+{
+	GlyphTable glyphs{};
+	auto add = [&] (char c, std::uint8_t points, bool Glyph::*role) {
+		if(c != Canvas::Transparent && c != Canvas::Blank) {
+			Glyph& glyph = glyphs[static_cast<unsigned char>(c)];
+			glyph.points |= points;
+			glyph.*role = true;
+		}
+	};
+
+	auto& sm = msm.get<ArrowStyle>();
+	for(auto id : sm.styles) {
+		const ArrowStyle& st = sm.table[id];
+		add(st.vertical, North | South, &Glyph::line);
+		add(st.horizontal, East | West, &Glyph::line);
+		add(st.tl, South | East, &Glyph::corner);
+		add(st.tr, South | West, &Glyph::corner);
+		add(st.bl, North | East, &Glyph::corner);
+		add(st.br, North | West, &Glyph::corner);
+		add(st.up, South, &Glyph::head);
+		add(st.down, North, &Glyph::head);
+		add(st.left, East, &Glyph::head);
+		add(st.right, West, &Glyph::head);
+	}
+	return glyphs;
+}
+
+/**
+ * Return if \p glyph can be drawn over a box side going in the directions \p
+ * across (i.e. an arrow entering or leaving the box, or a junction).
+ */
+static bool crosses(const Glyph& glyph, std::uint8_t across)
+{
+	return (glyph.points & across) != 0;
+}
+
+/**
+ * Find the boxes drawn with style \p id, marking their cells as used.
+ */
+static void find_boxes(Grid& grid, const GlyphTable& glyphs, const MultiStyleManager& msm,
+	StyleId<BoxStyle> id, point origin, ElementStack& out)
+{
+	const BoxStyle& st = msm.get<BoxStyle>().table[id];
+	if(st.tl_corner == Canvas::Transparent || st.tl_corner == Canvas::Blank) {
+		return;
+	}
+
+	// a side must be the side glyph, or an arrow crossing it
+	auto side = [&] (int x, int y, char c, std::uint8_t across) {
+		size_t idx = grid.index(x, y);
+		if(idx == Grid::npos || grid.use[idx] != CellUse::Free) {
+			return false;
+		}
+		char here = grid.text[idx];
+		return here == c || crosses(glyphs[static_cast<unsigned char>(here)], across);
+	};
+	auto mark = [&] (int x, int y, char c) {
+		size_t idx = grid.index(x, y);
+		grid.use[idx] = grid.text[idx] == c ? CellUse::Box : CellUse::Shared;
+	};
+
+	for(int y = 0; y < grid.rows(); ++y) {
+		for(int x = 0; x < grid.lengths[y]; ++x) {
+			if(!grid.free_is(x, y, st.tl_corner)) {
+				continue;
+			}
+
+			// each walk stops at the first corner, so each side is only
+			// walked from the one corner before it
+			int x2 = x + 1;
+			while(!grid.free_is(x2, y, st.tr_corner) && side(x2, y, st.tside, North | South)) {
+				++x2;
+			}
+			int y2 = y + 1;
+			while(!grid.free_is(x, y2, st.bl_corner) && side(x, y2, st.lside, East | West)) {
+				++y2;
+			}
+			if(!grid.free_is(x2, y, st.tr_corner) || !grid.free_is(x, y2, st.bl_corner)
+					|| !grid.free_is(x2, y2, st.br_corner)) {
+				continue;
+			}
+
+			bool closed = true;
+			for(int bx = x + 1; closed && bx < x2; ++bx) {
+				closed = side(bx, y2, st.bside, North | South);
+			}
+			for(int by = y + 1; closed && by < y2; ++by) {
+				closed = side(x2, by, st.rside, East | West);
+			}
+			if(!closed) {
+				continue;
+			}
+
+			for(int bx = x + 1; bx < x2; ++bx) {
+				mark(bx, y, st.tside);
+				mark(bx, y2, st.bside);
+			}
+			for(int by = y + 1; by < y2; ++by) {
+				mark(x, by, st.lside);
+				mark(x2, by, st.rside);
+			}
+			for(point corner : { point(x, y), point(x2, y), point(x, y2), point(x2, y2) }) {
+				grid.use[grid.index(corner.x, corner.y)] = CellUse::Box;
+			}
+			out.add<Box>(origin.x + x, origin.y + y, origin.x + x2, origin.y + y2, id);
+		}
+	}
+}
+
+/**
+ * Find the style of the arrow through \p cells, being the first whose glyphs
+ * are all of them, and which draws the same head at the end (or none, if the
+ * last cell isn't a head).
+ */
+static StyleId<ArrowStyle> arrow_style(const Grid& grid, const GlyphTable& table, const std::vector<point>& cells,
+	const MultiStyleManager& msm)
+{
+	point last = cells.back(), before = cells[cells.size() - 2];
+	char end = grid.at(last.x, last.y);
+	char head = table[static_cast<unsigned char>(end)].head ? end : '\0';
+
+	auto& sm = msm.get<ArrowStyle>();
+	StyleId<ArrowStyle> fallback = sm.get_first();
+	bool found = false;
+	for(auto id : sm.styles) {
+		const ArrowStyle& st = sm.table[id];
+		const char glyphs[] = { st.vertical, st.horizontal, st.tl, st.tr, st.bl, st.br, st.up, st.down, st.left, st.right };
+		bool matches = std::all_of(cells.begin(), cells.end(), [&] (point cell) {
+			return std::find(std::begin(glyphs), std::end(glyphs), grid.at(cell.x, cell.y)) != std::end(glyphs);
+		});
+		if(!matches) {
+			continue;
+		}
+
+		char drawn = last.x > before.x ? st.right : last.x < before.x ? st.left
+			: last.y > before.y ? st.down : st.up;
+		if(drawn == head) {
+			return id;
+		} else if(!found) {
+			fallback = id;
+			found = true;
+		}
+	}
+	return fallback;
+}
+
+/**
+ * Make an arrow following \p cells (each next to the one before).
+ *
+ * Each straight run is a leg of the path, and each pair of legs is one
+ * segment of the arrow, going in the direction of the first of the pair.
+ */
+static std::unique_ptr<Arrow> make_arrow(const std::vector<point>& cells, point origin, StyleId<ArrowStyle> style)
+{
+	auto at = [&] (point cell) {
+		return point(origin.x + cell.x, origin.y + cell.y);
+	};
+	auto arrow = std::make_unique<Arrow>(at(cells.front()).x, at(cells.front()).y, style);
+
+	// the ends of each leg, and if it's vertical
+	std::vector<std::pair<point, bool>> legs;
+	for(size_t idx = 1; idx < cells.size(); ++idx) {
+		bool vertical = cells[idx].x == cells[idx - 1].x;
+		if(legs.empty() || legs.back().second != vertical) {
+			legs.emplace_back(cells[idx], vertical);
+		} else {
+			legs.back().first = cells[idx];
+		}
+	}
+
+	for(size_t idx = 0; idx < legs.size(); idx += 2) {
+		auto dir = legs[idx].second ? Arrow::Vertical : Arrow::Horizontal;
+		point to = legs[std::min(idx + 1, legs.size() - 1)].first;
+		arrow->add_point(at(to).x, at(to).y, dir);
+	}
+	return arrow;
+}
+
+/**
+ * Find the arrows in the cells not used by boxes.
+ *
+ * Neighbouring glyphs are linked if they connect to each other (lines also
+ * connect to anything pointing into them, as a corner may be drawn as a
+ * line). Each connected component of the links is then traced into paths,
+ * using each link once, and going straight through crossings.
+ */
+static void find_arrows(Grid& grid, const GlyphTable& glyphs, const MultiStyleManager& msm, point origin, ElementStack& out)
+{
+	auto glyph_of = [&] (size_t idx) -> const Glyph& {
+		return glyphs[static_cast<unsigned char>(grid.text[idx])];
+	};
+	auto usable = [&] (size_t idx) {
+		return idx != Grid::npos && grid.use[idx] != CellUse::Box && glyph_of(idx).points != 0;
+	};
+
+	std::vector<std::uint8_t> links(grid.text.size(), 0);
+	std::vector<std::uint8_t> used(grid.text.size(), 0); // links already traced
+	for(int y = 0; y < grid.rows(); ++y) {
+		for(int x = 0; x < grid.lengths[y]; ++x) {
+			size_t idx = grid.index(x, y);
+			if(!usable(idx)) {
+				continue;
+			}
+			const Glyph& here = glyph_of(idx);
+
+			// only look east and south, linking both ways
+			for(std::uint8_t dir : { East, South }) {
+				point next = step(point(x, y), dir);
+				size_t other = grid.index(next.x, next.y);
+				if(!usable(other)) {
+					continue;
+				}
+				const Glyph& there = glyph_of(other);
+				bool out_ok = (here.points & dir) != 0;
+				bool in_ok = (there.points & opposite(dir)) != 0;
+				bool linked = (out_ok || in_ok)
+					&& (here.line || out_ok) && (there.line || in_ok) // strict unless a line
+					&& !(here.corner && there.corner && !here.line && !there.line);
+				if(linked) {
+					links[idx] |= dir;
+					links[other] |= opposite(dir);
+				}
+			}
+		}
+	}
+
+	auto trace = [&] (point start) {
+		std::vector<point> cells{ start };
+		bool heads = glyph_of(grid.index(start.x, start.y)).head;
+		bool bodies = !glyph_of(grid.index(start.x, start.y)).head;
+
+		point pos = start;
+		std::uint8_t moving = 0;
+		while(true) {
+			size_t idx = grid.index(pos.x, pos.y);
+			std::uint8_t open = links[idx] & ~used[idx];
+			if(!open) {
+				break;
+			}
+			std::uint8_t dir = (open & moving) ? moving : (open & -open); // straight if possible
+
+			point next = step(pos, dir);
+			size_t other = grid.index(next.x, next.y);
+			used[idx] |= dir;
+			used[other] |= opposite(dir);
+
+			cells.push_back(next);
+			heads = heads || glyph_of(other).head;
+			bodies = bodies || !glyph_of(other).head;
+			pos = next;
+			moving = dir;
+		}
+
+		// too short to tell apart from punctuation
+		if(!bodies || cells.size() < (heads ? 2u : 3u)) {
+			return;
+		}
+		for(point cell : cells) {
+			size_t idx = grid.index(cell.x, cell.y);
+			if(grid.use[idx] == CellUse::Free) {
+				grid.use[idx] = CellUse::Arrow;
+			}
+		}
+
+		// arrows are drawn with the head at the end
+		if(glyph_of(grid.index(start.x, start.y)).head && !glyph_of(grid.index(pos.x, pos.y)).head) {
+			std::reverse(cells.begin(), cells.end());
+		}
+		out.elements.push_back(make_arrow(cells, origin, arrow_style(grid, glyphs, cells, msm)));
+	};
+
+	// start from the ends (odd numbers of links) first, then do the loops
+	for(bool ends : { true, false }) {
+		for(int y = 0; y < grid.rows(); ++y) {
+			for(int x = 0; x < grid.lengths[y]; ++x) {
+				size_t idx = grid.index(x, y);
+				std::uint8_t open = links[idx] & ~used[idx];
+				bool odd = ((links[idx] & North) != 0) ^ ((links[idx] & East) != 0)
+					^ ((links[idx] & South) != 0) ^ ((links[idx] & West) != 0);
+				while(open && (odd || !ends)) {
+					trace(point(x, y));
+					open = links[idx] & ~used[idx];
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Gather the chars which aren't part of anything else into Text.
+ *
+ * Each row is split into runs (allowing single spaces between words), and
+ * runs on consecutive rows which start in the same column are joined into one
+ * block.
+ */
+static void find_text(const Grid& grid, point origin, ElementStack& out)
+{
+	struct Block
+	{
+		int x, y; // of the first char
+		std::string content;
+	};
+
+	auto is_text = [&] (int x, int y) {
+		size_t idx = grid.index(x, y);
+		return idx != Grid::npos && grid.text[idx] != ' ' && grid.use[idx] == CellUse::Free;
+	};
+	auto finish = [&] (Block& block) {
+		out.add<Text>(origin.x + block.x, origin.y + block.y);
+		out.back_as<Text>()->rope.insert(0, block.content);
+	};
+
+	std::vector<Block> open, next; // by column, for the previous and current rows
+	for(int y = 0; y < grid.rows(); ++y) {
+		size_t prev = 0;
+		for(int x = 0; x < grid.lengths[y]; ++x) {
+			if(!is_text(x, y)) {
+				continue;
+			}
+			int start = x;
+			while(is_text(x + 1, y) || (grid.at(x + 1, y) == ' ' && is_text(x + 2, y))) {
+				++x;
+			}
+			strview line(grid.text.data() + grid.starts[y] + start, x - start + 1);
+
+			// blocks (sorted by column) of the previous row which can't
+			// continue are finished
+			while(prev < open.size() && open[prev].x < start) {
+				finish(open[prev++]);
+			}
+			if(prev < open.size() && open[prev].x == start) {
+				next.push_back(std::move(open[prev++]));
+				next.back().content.push_back('\n');
+				next.back().content.append(line.data(), line.size());
+			} else {
+				next.push_back(Block{ start, y, line.str() });
+			}
+		}
+		while(prev < open.size()) {
+			finish(open[prev++]);
+		}
+		open.swap(next);
+		next.clear();
+	}
+	for(auto& block : open) {
+		finish(block);
+	}
+}
+
+size_t recognize_art(strview text, point origin, const MultiStyleManager& msm, ElementStack& out)
+{
+	Grid grid{clean_text(text)};
+	GlyphTable glyphs = arrow_glyphs(msm);
+	size_t before = out.elements.size();
+
+	for(auto id : msm.get<BoxStyle>().styles) {
+		find_boxes(grid, glyphs, msm, id, origin, out);
+	}
+	find_arrows(grid, glyphs, msm, origin, out);
+	find_text(grid, origin, out);
+
+	out.invalidate();
+	return out.elements.size() - before;
+}
+
+bool import_art(const std::string& path, point origin, const MultiStyleManager& msm, ElementStack& out)
+{
+	auto mapping = FileMapping::open(path);
+	if(!mapping) {
+		return false;
+	}
+	recognize_art(mapping->contents(), origin, msm, out);
+	return true;
+}
+
+void add_art_styles(MultiStyleManager& msm)
+{
+	auto add = [] (auto& sm, const auto& style) {
+		auto id = sm.table.intern(style);
+		if(std::find(sm.styles.begin(), sm.styles.end(), id) == sm.styles.end()) {
+			sm.styles.push_back(id);
+		}
+	};
+
+	BoxStyle box;
+	box.tl_corner = box.tr_corner = box.bl_corner = box.br_corner = '+';
+	add(msm.get<BoxStyle>(), box);
+
+	// lines without heads, as well as the default arrow and one with '+'
+	// corners
+	ArrowStyle arrow;
+	arrow.tl = arrow.tr = arrow.bl = arrow.br = '+';
+	add(msm.get<ArrowStyle>(), arrow);
+	for(ArrowStyle line : { ArrowStyle(), arrow }) {
+		line.up = line.down = line.left = line.right = Canvas::Transparent;
+		add(msm.get<ArrowStyle>(), line);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines recognize_art(), which converts plain text ASCII art into
+ * elements (Boxes, Arrows, and Text), so that it can be edited structurally.
+ */
+
+#include "base.hpp"
+#include "drawable.hpp"
+#include "multistyle.hpp"
+
+#include <string>
+
+/**
+ * Recognize the ASCII art in \p text, adding the elements found to \p out,
+ * with the top left of the text at \p origin. Returns the number of elements
+ * added.
+ *
+ * Boxes and arrows are matched against the styles in \p msm (in display
+ * order), and use the first style which they match:
+ * - Boxes need all four corners and sides, though arrows may cross the sides.
+ * - Arrows are traced through the lines, corners, and heads of arrow styles,
+ *   as connected paths of at least three cells (or two with a head). They
+ *   end at their head, if they have one, and prefer a style with that head.
+ * - Everything else is kept as Text, in left-aligned blocks.
+ *
+ * The text is cleaned first (see clean_text()). This takes time linear in the
+ * size of the text.
+ */
+size_t recognize_art(strview text, point origin, const MultiStyleManager& msm, ElementStack& out);
+
+/**
+ * Read the file at \p path and recognize the art in it (see recognize_art()).
+ * Returns false if it cannot be read.
+ */
+bool import_art(const std::string& path, point origin, const MultiStyleManager& msm, ElementStack& out);
+
+/**
+ * Add styles for the most common hand-drawn forms of boxes and arrows (with
+ * '+' corners, and lines without heads) to \p msm, after its existing ones,
+ * unless they are already there.
+ */
+void add_art_styles(MultiStyleManager& msm);
@@ -0,0 +1,101 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines LruCache, a size-limited cache which evicts the least
+ * recently used entries first, along with the hash used for its keys.
+ */
+
+#include "../base.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * A 64-bit FNV-1a hash of \p data, used to identify documents by content.
+ */
+inline std::uint64_t content_hash(strview data)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	for(char c : data) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * A cache from \p K to \p V, limited to a total cost (e.g. bytes). When full,
+ * the least recently used entries are evicted.
+ *
+ * This is not thread-safe; the user must lock it themselves.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+struct LruCache
+{
+	struct Entry
+	{
+		K key;
+		V value;
+		size_t cost;
+	};
+
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<K, typename std::list<Entry>::iterator, Hash> index;
+	size_t capacity;
+	size_t used = 0;
+public:
+	explicit LruCache(size_t capacity)
+		: capacity(capacity)
+	{
+	}
+
+	/**
+	 * Get the value for \p key, marking it as recently used, or null if it
+	 * isn't cached.
+	 */
+	V* find(const K& key)
+	{
+		auto it = index.find(key);
+		if(it == index.end()) {
+			return nullptr;
+		}
+		entries.splice(entries.begin(), entries, it->second);
+		return &it->second->value;
+	}
+
+	/**
+	 * Add \p value for \p key (replacing any existing one) with cost \p
+	 * cost, evicting other entries to make room. Values costing more than
+	 * the capacity aren't added.
+	 */
+	void insert(const K& key, V value, size_t cost)
+	{
+		auto it = index.find(key);
+		if(it != index.end()) {
+			used -= it->second->cost;
+			entries.erase(it->second);
+			index.erase(it);
+		}
+		if(cost > capacity) {
+			return;
+		}
+
+		while(used + cost > capacity) {
+			used -= entries.back().cost;
+			index.erase(entries.back().key);
+			entries.pop_back();
+		}
+
+		entries.push_front(Entry{ key, std::move(value), cost });
+		index.emplace(key, entries.begin());
+		used += cost;
+	}
+
+	size_t size() const
+	{
+		return entries.size();
+	}
+};
@@ -0,0 +1,92 @@
+#include "protocol.hpp"
+
+#include "../mapping.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+int run_client(const std::string& socket_path, const std::vector<std::string>& paths,
+	const int* region, bool timing)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if(socket_path.size() >= sizeof(addr.sun_path)) {
+		std::fprintf(stderr, "%s: socket path too long\n", socket_path.c_str());
+		return 1;
+	}
+	std::strcpy(addr.sun_path, socket_path.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+		std::perror(socket_path.c_str());
+		return 1;
+	}
+
+	int status = 0;
+	std::string text;
+	for(auto& path : paths) {
+		auto mapping = FileMapping::open(path);
+		if(!mapping) {
+			std::fprintf(stderr, "%s: cannot read\n", path.c_str());
+			status = 1;
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		RenderRequest req{ request_magic, 0, 0, 0, 0, 0, mapping->size };
+		if(region) {
+			req.flags |= region_flag;
+			req.x1 = region[0];
+			req.y1 = region[1];
+			req.x2 = region[2];
+			req.y2 = region[3];
+		}
+
+		RenderResponse resp;
+		if(!send_all(fd, &req, sizeof(req)) || !send_all(fd, mapping->data, mapping->size)
+			|| !recv_all(fd, &resp, sizeof(resp)) || resp.magic != response_magic) {
+			std::fprintf(stderr, "%s: connection to server failed\n", path.c_str());
+			status = 1;
+			break;
+		}
+
+		text.resize(resp.size);
+		if(!recv_all(fd, &text[0], text.size())) {
+			std::fprintf(stderr, "%s: connection to server failed\n", path.c_str());
+			status = 1;
+			break;
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if(resp.status != RenderStatus::Ok) {
+			std::fprintf(stderr, "%s: cannot render\n", path.c_str());
+			status = 1;
+			continue;
+		}
+
+		std::fwrite(text.data(), 1, text.size(), stdout);
+		if(timing) {
+			static const char* cached_names[] = { "not cached", "document cached", "text cached" };
+			std::fprintf(stderr, "%s: %.3f ms (%s)\n", path.c_str(), ms, cached_names[resp.cached % 3]);
+		}
+	}
+
+	close(fd);
+	return status;
+}
+#else
+int run_client(const std::string& /* socket_path */, const std::vector<std::string>& /* paths */,
+	const int* /* region */, bool /* timing */)
+{
+	std::fprintf(stderr, "The render server needs Unix domain sockets\n");
+	return 1;
+}
+#endif
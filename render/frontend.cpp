@@ -0,0 +1,301 @@
+/**
+ * \file
+ * The main file of the batch renderer, which renders documents to plain text
+ * without a terminal.
+ *
+ * Each document is rendered over its bounds (or a given region), either to
+ * stdout (in the order given) or to a file per document. Documents are
+ * rendered concurrently by a pool of workers, and the time taken for each is
+ * reported on stderr.
+ *
+ * This can also run as a server, which keeps documents and their renderings
+ * cached between requests, or as a client of one (see protocol.hpp).
+ *
+ * In reverse, plain text files can be converted into documents, recognizing
+ * the boxes and arrows drawn in them (see recognize.hpp).
+ */
+
+#include "protocol.hpp"
+
+#include "../document.hpp"
+#include "../export.hpp"
+#include "../fileformat.hpp"
+#include "../recognize.hpp"
+#include "../sprite.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static const char* usage = R"(Usage: render [options] file...
+       render -s SOCKET [-m MB]
+       render -c SOCKET [-r X1,Y1,X2,Y2] [-q] file...
+       render -a [-j N] [-o DIR] [-q] file...
+Render asciigram documents as plain text.
+
+Options:
+  -j N        Render with N workers (default: the number of processors)
+  -o DIR      Write each document to DIR/<name>.txt, instead of to stdout
+  -r X1,Y1,X2,Y2
+              Render only the region between the corners (inclusive),
+                instead of everything drawn. Either can be up to 16M cells
+  -q          Don't report the time taken for each document
+  -s SOCKET   Run a server on the Unix domain socket SOCKET, which renders
+                documents sent to it, caching the results
+  -m MB       Cache up to MB megabytes in the server (default: 256)
+  -c SOCKET   Send the documents to the server at SOCKET to be rendered,
+                writing the results to stdout
+  -a          Convert plain text files (ASCII art) into documents instead,
+                recognizing the boxes and arrows drawn. Each is written to
+                DIR/<name>.agd with -o, or next to the file otherwise
+  -h          Show this message
+)";
+
+/**
+ * The result of rendering a single document.
+ */
+struct RenderJob
+{
+	std::string path;
+	std::string output; // unless written as it is rendered
+	bool ok = false;
+	double load_ms = 0, render_ms = 0;
+	bool done = false;
+};
+
+/**
+ * Render the document at \p job.path into \p sink. If \p region isn't null,
+ * only render that region (x1, y1, x2, y2). This fails if the region (or
+ * everything drawn) is too large to render.
+ */
+static void render_job(RenderJob& job, TextSink& sink, const int* region)
+{
+	using clock = std::chrono::steady_clock;
+	auto ms_since = [] (clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	auto start = clock::now();
+	auto doc = MappedDocument::open(job.path);
+	job.load_ms = ms_since(start);
+	if(!doc) {
+		return;
+	}
+
+	start = clock::now();
+	point p1, p2;
+	if(region) {
+		p1 = { region[0], region[1] };
+		p2 = { region[2], region[3] };
+	} else {
+		BoundsFinder bounds;
+		doc->draw(bounds);
+		if(bounds.empty()) {
+			job.ok = true; // nothing to write
+			return;
+		}
+		p1 = bounds.min;
+		p2 = bounds.max;
+	}
+	if(!can_render(p1.x, p1.y, p2.x, p2.y)) {
+		return;
+	}
+	job.ok = export_region(*doc, p1, p2, sink);
+	job.render_ms = ms_since(start);
+}
+
+/**
+ * Get the name of the output file for \p path in \p dir, replacing the
+ * extension with \p ext. If \p dir is empty, it's in the same directory as \p
+ * path.
+ */
+static std::string output_path(const std::string& dir, const std::string& path, const char* ext)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	if(dot != std::string::npos && dot != 0) {
+		name.erase(dot);
+	}
+	std::string parent = slash == std::string::npos ? "." : path.substr(0, slash);
+	return (dir.empty() ? parent : dir) + "/" + name + ext;
+}
+
+/**
+ * Convert the text file at \p job.path into a document at \p out, recognizing
+ * the elements drawn in it.
+ */
+static void convert_job(RenderJob& job, const std::string& out)
+{
+	using clock = std::chrono::steady_clock;
+	auto ms_since = [] (clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	auto start = clock::now();
+	Document doc;
+	add_art_styles(doc.msm);
+	if(!import_art(job.path, point(0, 0), doc.msm, doc.es)) {
+		return;
+	}
+	job.load_ms = ms_since(start);
+
+	start = clock::now();
+	job.ok = save_document(out, doc);
+	job.render_ms = ms_since(start);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+	std::string outdir; // stdout if empty
+	std::string server, client; // socket paths
+	size_t cache_mb = 256;
+	bool timing = true;
+	bool convert = false;
+	int region_storage[4];
+	const int* region = nullptr;
+	std::vector<RenderJob> jobs;
+
+	for(int idx = 1; idx < argc; ++idx) {
+		std::string arg = argv[idx];
+		if(arg.size() == 2 && std::strchr("josmcr", arg[1]) && arg[0] == '-' && idx + 1 < argc) {
+			const char* value = argv[++idx];
+			switch(arg[1]) {
+			case 'j':
+				workers = std::max(1, std::atoi(value));
+				break;
+			case 'o':
+				outdir = value;
+				break;
+			case 's':
+				server = value;
+				break;
+			case 'm':
+				cache_mb = std::max(1, std::atoi(value));
+				break;
+			case 'c':
+				client = value;
+				break;
+			case 'r':
+				if(std::sscanf(value, "%d,%d,%d,%d", &region_storage[0], &region_storage[1],
+						&region_storage[2], &region_storage[3]) != 4) {
+					std::fputs(usage, stderr);
+					return 2;
+				}
+				region = region_storage;
+				break;
+			}
+		} else if(arg == "-q") {
+			timing = false;
+		} else if(arg == "-a") {
+			convert = true;
+		} else if(arg == "-h" || (arg.size() > 1 && arg[0] == '-')) {
+			std::fputs(usage, arg == "-h" ? stdout : stderr);
+			return arg == "-h" ? 0 : 2;
+		} else {
+			jobs.emplace_back();
+			jobs.back().path = arg;
+		}
+	}
+
+	if(!server.empty()) {
+		return serve(server, cache_mb << 20);
+	}
+
+	if(jobs.empty()) {
+		std::fputs(usage, stderr);
+		return 2;
+	}
+
+	if(!client.empty()) {
+		std::vector<std::string> paths;
+		for(auto& job : jobs) {
+			paths.push_back(job.path);
+		}
+		return run_client(client, paths, region, timing);
+	}
+
+	std::mutex mutex;
+	std::condition_variable finished;
+	std::atomic<size_t> next{0};
+
+	// with a single worker, documents are rendered in order, so they can be
+	// written to stdout as they are rendered instead of held until then
+	size_t pool_size = std::min<size_t>(workers, jobs.size());
+	bool stream = outdir.empty() && pool_size == 1;
+
+	auto work = [&] {
+		for(size_t idx; (idx = next++) < jobs.size(); ) {
+			RenderJob& job = jobs[idx];
+			// a failure (such as running out of memory) only fails this job
+			try {
+				if(convert) {
+					convert_job(job, output_path(outdir, job.path, ".agd"));
+				} else if(stream) {
+					FileSink sink{stdout};
+					render_job(job, sink, region);
+				} else if(outdir.empty()) {
+					StringSink sink;
+					render_job(job, sink, region);
+					job.output = std::move(sink.text);
+				} else if(std::FILE* file = std::fopen(output_path(outdir, job.path, ".txt").c_str(), "wb")) {
+					FileSink sink{file};
+					render_job(job, sink, region);
+					job.ok = std::fclose(file) == 0 && job.ok;
+				}
+			} catch(const std::exception&) {
+				job.ok = false;
+				job.output = std::string();
+			}
+
+			std::lock_guard<std::mutex> lock{mutex};
+			job.done = true;
+			finished.notify_all();
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for(size_t idx = 0; idx < pool_size; ++idx) {
+		pool.emplace_back(work);
+	}
+
+	// report in order, as soon as each is done
+	int status = 0;
+	for(auto& job : jobs) {
+		{
+			std::unique_lock<std::mutex> lock{mutex};
+			finished.wait(lock, [&] { return job.done; });
+		}
+
+		if(!job.ok) {
+			std::fprintf(stderr, "%s: cannot %s\n", job.path.c_str(), convert ? "convert" : "render");
+			status = 1;
+			continue;
+		}
+		if(outdir.empty() && !convert) {
+			std::fwrite(job.output.data(), 1, job.output.size(), stdout);
+			job.output = std::string(); // free it early
+		}
+		if(timing && convert) {
+			std::fprintf(stderr, "%s: recognize %.3f ms, save %.3f ms\n", job.path.c_str(), job.load_ms, job.render_ms);
+		} else if(timing) {
+			std::fprintf(stderr, "%s: load %.3f ms, render %.3f ms\n", job.path.c_str(), job.load_ms, job.render_ms);
+		}
+	}
+
+	for(auto& thread : pool) {
+		thread.join();
+	}
+	return status;
+}
@@ -0,0 +1,51 @@
+#include "protocol.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool send_all(int fd, const void* data, size_t size)
+{
+	auto ptr = static_cast<const char*>(data);
+	while(size > 0) {
+		ssize_t sent = send(fd, ptr, size, 0);
+		if(sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if(sent <= 0) {
+			return false;
+		}
+		ptr += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool recv_all(int fd, void* data, size_t size)
+{
+	auto ptr = static_cast<char*>(data);
+	while(size > 0) {
+		ssize_t got = recv(fd, ptr, size, 0);
+		if(got < 0 && errno == EINTR) {
+			continue;
+		}
+		if(got <= 0) {
+			return false;
+		}
+		ptr += got;
+		size -= got;
+	}
+	return true;
+}
+#else
+bool send_all(int, const void*, size_t)
+{
+	return false;
+}
+
+bool recv_all(int, void*, size_t)
+{
+	return false;
+}
+#endif
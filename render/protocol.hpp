@@ -0,0 +1,100 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines the protocol used by the render server, which renders
+ * documents sent to it over a Unix domain socket.
+ *
+ * A client connects and sends any number of requests, each a RenderRequest
+ * followed by the contents of a document file. For each, the server replies
+ * with a RenderResponse followed by the rendered text. Both ends use native
+ * byte order, as they are on the same machine.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const std::uint32_t request_magic = 0x51524741; // "AGRQ"
+static const std::uint32_t response_magic = 0x53524741; // "AGRS"
+
+struct RenderRequest
+{
+	std::uint32_t magic;
+	std::uint32_t flags; // see below
+	std::int32_t x1, y1, x2, y2; // inclusive region, if region_flag is set
+	std::uint64_t size; // of the document
+};
+
+/// Render only the region given, instead of everything drawn.
+static const std::uint32_t region_flag = 1;
+
+/// The largest document accepted.
+static const std::uint64_t max_request_size = 256 << 20;
+
+/// The most cells which can be rendered for one request, whether a region or
+/// everything drawn, since the text is held in memory (and cached).
+static const std::int64_t max_region_cells = 1 << 24;
+
+/**
+ * Return if the region from (\p x1, \p y1) to (\p x2, \p y2) inclusive is
+ * small enough to render.
+ */
+inline bool can_render(int x1, int y1, int x2, int y2)
+{
+	// the renderer needs to represent one past the end of the region
+	if(std::max(x1, x2) == INT_MAX || std::max(y1, y2) == INT_MAX) {
+		return false;
+	}
+	std::int64_t width = std::abs(std::int64_t(x2) - x1) + 1;
+	std::int64_t height = std::abs(std::int64_t(y2) - y1) + 1;
+	return width <= max_region_cells && height <= max_region_cells / width;
+}
+
+enum class RenderStatus : std::uint32_t
+{
+	Ok,
+	InvalidDocument,
+	InvalidRequest,
+};
+
+struct RenderResponse
+{
+	std::uint32_t magic;
+	RenderStatus status;
+	std::uint32_t cached; // whether the document and/or text were cached (1/2)
+	std::uint32_t reserved;
+	std::uint64_t size; // of the text
+};
+
+static_assert(sizeof(RenderRequest) == 32, "RenderRequest must not have padding");
+static_assert(sizeof(RenderResponse) == 24, "RenderResponse must not have padding");
+
+/**
+ * Write all \p size bytes of \p data to the socket \p fd.
+ */
+bool send_all(int fd, const void* data, size_t size);
+
+/**
+ * Read exactly \p size bytes from the socket \p fd into \p data. Returns false
+ * on errors or if the connection is closed first.
+ */
+bool recv_all(int fd, void* data, size_t size);
+
+/**
+ * Serve render requests on the socket at \p path until killed, keeping up to
+ * \p cache_size bytes of documents and rendered text cached.
+ */
+int serve(const std::string& path, size_t cache_size);
+
+/**
+ * Send the documents at \p paths to the server at \p socket_path (rendering
+ * the region \p region if not null, as x1, y1, x2, y2), and write the results
+ * to stdout. If \p timing is set, the time taken is reported on stderr.
+ */
+int run_client(const std::string& socket_path, const std::vector<std::string>& paths,
+	const int* region, bool timing);
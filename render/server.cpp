@@ -0,0 +1,292 @@
+#include "protocol.hpp"
+
+#include "cache.hpp"
+
+#include "../document.hpp"
+#include "../export.hpp"
+#include "../fileformat.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * A parsed document, along with the data it was parsed from (which its text
+ * refers to).
+ */
+struct CachedDocument
+{
+	std::shared_ptr<const std::string> data;
+	std::shared_ptr<const Document> document; // prepared, so it can be shared
+};
+
+/**
+ * A rendering, along with the document data it was rendered from, since
+ * different documents can have the same RenderKey.
+ */
+struct CachedRender
+{
+	std::shared_ptr<const std::string> data;
+	std::shared_ptr<const std::string> text;
+};
+
+/**
+ * Identifies a rendering: the document (by hash), and the region.
+ */
+struct RenderKey
+{
+	std::uint64_t hash, size;
+	std::uint32_t flags;
+	std::int32_t x1, y1, x2, y2;
+public:
+	bool operator==(const RenderKey& other) const
+	{
+		return hash == other.hash && size == other.size && flags == other.flags
+			&& x1 == other.x1 && y1 == other.y1 && x2 == other.x2 && y2 == other.y2;
+	}
+};
+
+struct RenderKeyHash
+{
+	size_t operator()(const RenderKey& key) const
+	{
+		std::uint64_t hash = key.hash;
+		for(std::int32_t part : { std::int32_t(key.flags), key.x1, key.y1, key.x2, key.y2 }) {
+			hash = (hash ^ static_cast<std::uint32_t>(part)) * 1099511628211ull;
+		}
+		return hash;
+	}
+};
+
+/**
+ * The state shared by all connections.
+ */
+struct RenderServer
+{
+	/// The most clients served at once, as each can use a lot of memory
+	/// (a request of up to max_request_size, and its rendering).
+	static constexpr int max_connections = 8;
+
+	std::mutex mutex; // for the caches
+	LruCache<std::uint64_t, CachedDocument> documents;
+	LruCache<RenderKey, CachedRender, RenderKeyHash> renders;
+
+	std::mutex connection_mutex;
+	std::condition_variable connection_closed;
+	int connections = 0;
+public:
+	explicit RenderServer(size_t cache_size)
+		: documents(cache_size / 2), renders(cache_size / 2)
+	{
+	}
+
+	/**
+	 * Get the document \p data, parsing it if it isn't cached. Returns
+	 * null if it isn't valid.
+	 */
+	std::shared_ptr<const Document> document(std::uint64_t hash, std::shared_ptr<const std::string> data, bool& cached)
+	{
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			auto found = documents.find(hash);
+			if(found && *found->data == *data) {
+				cached = true;
+				return found->document;
+			}
+		}
+
+		// parse without holding the lock
+		auto document = std::make_shared<Document>();
+		if(!load_document(*data, data, *document)) {
+			return nullptr;
+		}
+		document->prepare();
+
+		std::lock_guard<std::mutex> lock{mutex};
+		size_t cost = data->size() * 2; // about as much again for the elements
+		documents.insert(hash, CachedDocument{ data, document }, cost);
+		return document;
+	}
+
+	/**
+	 * Wait until another client can be served, and count it as connected.
+	 */
+	void wait_for_connection()
+	{
+		std::unique_lock<std::mutex> lock{connection_mutex};
+		connection_closed.wait(lock, [this] { return connections < max_connections; });
+		++connections;
+	}
+
+	/**
+	 * Handle all requests from the client connected to \p fd, which was
+	 * counted by wait_for_connection(). Any error (such as running out of
+	 * memory) only closes the connection.
+	 */
+	void handle(int fd)
+	{
+		try {
+			this->handle_requests(fd);
+		} catch(const std::exception& err) {
+			std::fprintf(stderr, "render server: %s\n", err.what());
+		}
+		close(fd);
+		this->end_connection();
+	}
+
+	/**
+	 * Stop counting a client counted by wait_for_connection().
+	 */
+	void end_connection()
+	{
+		std::lock_guard<std::mutex> lock{connection_mutex};
+		--connections;
+		connection_closed.notify_one();
+	}
+
+private:
+	void handle_requests(int fd)
+	{
+		RenderRequest req;
+		while(recv_all(fd, &req, sizeof(req))) {
+			RenderResponse resp{ response_magic, RenderStatus::Ok, 0, 0, 0 };
+			bool too_large = (req.flags & region_flag)
+				&& !can_render(req.x1, req.y1, req.x2, req.y2);
+			if(req.magic != request_magic || req.size > max_request_size || too_large) {
+				resp.status = RenderStatus::InvalidRequest;
+				send_all(fd, &resp, sizeof(resp));
+				break; // can't tell where the next one starts
+			}
+
+			auto data = std::make_shared<std::string>(req.size, '\0');
+			if(!recv_all(fd, &(*data)[0], data->size())) {
+				break;
+			}
+
+			RenderKey key{ content_hash(*data), req.size, req.flags & region_flag, 0, 0, 0, 0 };
+			if(key.flags & region_flag) {
+				key.x1 = req.x1;
+				key.y1 = req.y1;
+				key.x2 = req.x2;
+				key.y2 = req.y2;
+			}
+
+			std::shared_ptr<const std::string> text;
+			{
+				std::lock_guard<std::mutex> lock{mutex};
+				auto found = renders.find(key);
+				if(found && *found->data == *data) {
+					text = found->text;
+					resp.cached = 2;
+				}
+			}
+
+			if(!text) {
+				bool cached = false;
+				auto document = this->document(key.hash, data, cached);
+				point min{ key.x1, key.y1 }, max{ key.x2, key.y2 };
+				bool drawn = document && ((key.flags & region_flag) || document->bounds(min, max));
+				if(!document) {
+					resp.status = RenderStatus::InvalidDocument;
+				} else if(drawn && !can_render(min.x, min.y, max.x, max.y)) {
+					resp.status = RenderStatus::InvalidRequest;
+				} else {
+					resp.cached = cached;
+					StringSink rendered;
+					if(drawn) {
+						export_region(*document, min, max, rendered);
+					}
+					text = std::make_shared<std::string>(std::move(rendered.text));
+
+					// the data is counted too, although it's usually
+					// shared with the cached document
+					std::lock_guard<std::mutex> lock{mutex};
+					renders.insert(key, CachedRender{ data, text }, data->size() + text->size() + sizeof(key));
+				}
+			}
+
+			resp.size = text ? text->size() : 0;
+			if(!send_all(fd, &resp, sizeof(resp)) || (text && !send_all(fd, text->data(), text->size()))) {
+				break;
+			}
+		}
+	}
+};
+
+int serve(const std::string& path, size_t cache_size)
+{
+	std::signal(SIGPIPE, SIG_IGN); // handled where sending
+
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(addr.sun_path)) {
+		std::fprintf(stderr, "%s: socket path too long\n", path.c_str());
+		return 1;
+	}
+	std::strcpy(addr.sun_path, path.c_str());
+
+	// replace a socket left over from an earlier server, but nothing else
+	struct stat existing;
+	if(lstat(path.c_str(), &existing) == 0) {
+		if(!S_ISSOCK(existing.st_mode)) {
+			std::fprintf(stderr, "%s: exists, and isn't a socket\n", path.c_str());
+			return 1;
+		}
+		unlink(path.c_str());
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+		|| listen(listener, 64) < 0) {
+		std::perror(path.c_str());
+		return 1;
+	}
+
+	RenderServer server{cache_size};
+	while(true) {
+		// clients beyond the limit wait to be accepted
+		server.wait_for_connection();
+		int fd = accept(listener, nullptr, nullptr);
+		if(fd < 0) {
+			int error = errno;
+			server.end_connection();
+			if(error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+				// out of resources, until some connections close
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			} else if(error != EINTR && error != ECONNABORTED) {
+				std::perror(path.c_str());
+				return 1;
+			}
+			continue;
+		}
+		try {
+			std::thread([&server, fd] { server.handle(fd); }).detach();
+		} catch(const std::system_error& err) {
+			std::fprintf(stderr, "render server: %s\n", err.what());
+			close(fd);
+			server.end_connection();
+		}
+	}
+}
+#else
+int serve(const std::string& /* path */, size_t /* cache_size */)
+{
+	std::fprintf(stderr, "The render server needs Unix domain sockets\n");
+	return 1;
+}
+#endif
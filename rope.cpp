@@ -0,0 +1,287 @@
+#include "rope.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+using NodePtr = Rope::NodePtr;
+using Node = Rope::Node;
+
+constexpr size_t Rope::leaf_size;
+
+static size_t size_of(const NodePtr& node)
+{
+	return node ? node->total_size : 0;
+}
+
+static size_t newlines_of(const NodePtr& node)
+{
+	return node ? node->total_newlines : 0;
+}
+
+static size_t count_newlines(strview text)
+{
+	size_t count = 0;
+	for(size_t pos = text.find('\n'); pos != strview::npos; pos = text.find('\n', pos + 1)) {
+		++count;
+	}
+	return count;
+}
+
+/**
+ * Get the offset of newline number \p nth (from 1) in \p text, which must
+ * have at least that many.
+ */
+static size_t find_newline(strview text, size_t nth)
+{
+	size_t pos = text.find('\n');
+	while(--nth) {
+		pos = text.find('\n', pos + 1);
+	}
+	return pos;
+}
+
+static std::uint32_t random_priority()
+{
+	// xorshift, per thread so that ropes can be built concurrently
+	thread_local std::uint32_t state = 2463534242u;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+/**
+ * Make a node from \p left, \p right, and the piece (\p text, with \p
+ * newlines newlines, kept alive by \p storage).
+ */
+static NodePtr make_node(NodePtr left, NodePtr right, std::shared_ptr<const void> storage,
+	strview text, size_t newlines, std::uint32_t priority)
+{
+	auto node = std::make_shared<Node>();
+	node->total_size = size_of(left) + text.size() + size_of(right);
+	node->total_newlines = newlines_of(left) + newlines + newlines_of(right);
+	node->left = std::move(left);
+	node->right = std::move(right);
+	node->storage = std::move(storage);
+	node->text = text;
+	node->newlines = newlines;
+	node->priority = priority;
+	return node;
+}
+
+/**
+ * Make a copy of \p node with different children.
+ */
+static NodePtr with_children(const Node& node, NodePtr left, NodePtr right)
+{
+	return make_node(std::move(left), std::move(right), node.storage, node.text, node.newlines, node.priority);
+}
+
+/**
+ * Split \p node into the first \p offset chars, and the rest.
+ */
+static std::pair<NodePtr, NodePtr> split(const NodePtr& node, size_t offset)
+{
+	if(!node) {
+		return {};
+	}
+
+	size_t left_size = size_of(node->left);
+	size_t past = left_size + node->text.size();
+	if(offset <= left_size) {
+		auto parts = split(node->left, offset);
+		return { std::move(parts.first), with_children(*node, std::move(parts.second), node->right) };
+	} else if(offset >= past) {
+		auto parts = split(node->right, offset - past);
+		return { with_children(*node, node->left, std::move(parts.first)), std::move(parts.second) };
+	}
+
+	// cut the piece itself, sharing its storage
+	strview first = node->text.substr(0, offset - left_size);
+	strview second = node->text.substr(offset - left_size);
+	size_t first_newlines = count_newlines(first);
+	return {
+		make_node(node->left, nullptr, node->storage, first, first_newlines, node->priority),
+		make_node(nullptr, node->right, node->storage, second, node->newlines - first_newlines, node->priority)
+	};
+}
+
+/**
+ * Join \p left and \p right, with all of \p left first.
+ */
+static NodePtr merge(const NodePtr& left, const NodePtr& right)
+{
+	if(!left) {
+		return right;
+	} else if(!right) {
+		return left;
+	}
+
+	if(left->priority > right->priority) {
+		return with_children(*left, left->left, merge(left->right, right));
+	} else {
+		return with_children(*right, merge(left, right->left), right->right);
+	}
+}
+
+/**
+ * Build a tree of the pieces of \p text (of at most leaf_size chars), kept
+ * alive by \p storage, in O(n).
+ */
+static NodePtr build(strview text, const std::shared_ptr<const void>& storage)
+{
+	struct Piece
+	{
+		strview text;
+		std::uint32_t priority;
+		NodePtr left; // built so far
+	};
+
+	// build the cartesian tree with a stack of the right spine
+	std::vector<Piece> spine;
+	auto fold = [&] (NodePtr right) {
+		Piece top = std::move(spine.back());
+		spine.pop_back();
+		return make_node(std::move(top.left), std::move(right), storage, top.text, count_newlines(top.text), top.priority);
+	};
+	for(size_t start = 0; start < text.size(); start += Rope::leaf_size) {
+		Piece piece{ text.substr(start, Rope::leaf_size), random_priority(), nullptr };
+		NodePtr below;
+		while(!spine.empty() && spine.back().priority < piece.priority) {
+			below = fold(std::move(below));
+		}
+		piece.left = std::move(below);
+		spine.push_back(std::move(piece));
+	}
+
+	NodePtr tree;
+	while(!spine.empty()) {
+		tree = fold(std::move(tree));
+	}
+	return tree;
+}
+
+/**
+ * Build a tree of a copy of \p text.
+ */
+static NodePtr build_copy(strview text)
+{
+	auto storage = std::make_shared<const std::string>(text.str());
+	return build(strview(*storage), storage);
+}
+
+Rope::Rope(strview text, std::shared_ptr<const void> keep_alive)
+	: root(build(text, keep_alive))
+{
+}
+
+char Rope::at(size_t offset) const
+{
+	const Node* node = root.get();
+	while(true) {
+		size_t left_size = size_of(node->left);
+		if(offset < left_size) {
+			node = node->left.get();
+		} else if(offset < left_size + node->text.size()) {
+			return node->text[offset - left_size];
+		} else {
+			offset -= left_size + node->text.size();
+			node = node->right.get();
+		}
+	}
+}
+
+void Rope::insert(size_t offset, strview text)
+{
+	if(text.empty()) {
+		return;
+	}
+
+	auto parts = split(root, std::min(offset, this->size()));
+
+	// join with the piece before if small, so typing doesn't make a node
+	// for every char
+	size_t before = 0;
+	for(const Node* node = parts.first.get(); node; node = node->right.get()) {
+		before = node->text.size();
+	}
+	if(before > 0 && before + text.size() <= leaf_size) {
+		auto last = split(parts.first, size_of(parts.first) - before);
+		std::string joined = last.second->text.str();
+		joined.append(text.data(), text.size());
+		parts.first = merge(last.first, build_copy(joined));
+	} else {
+		parts.first = merge(parts.first, build_copy(text));
+	}
+
+	root = merge(parts.first, parts.second);
+}
+
+void Rope::erase(size_t offset, size_t count)
+{
+	auto parts = split(root, offset);
+	auto rest = split(parts.second, count);
+	root = merge(parts.first, rest.second);
+}
+
+size_t Rope::line_start(size_t line) const
+{
+	if(line == 0) {
+		return 0;
+	}
+
+	// find newline number `line`, and start just after it
+	size_t offset = 0;
+	const Node* node = root.get();
+	while(node) {
+		size_t left_newlines = newlines_of(node->left);
+		if(line <= left_newlines) {
+			node = node->left.get();
+		} else if(line <= left_newlines + node->newlines) {
+			return offset + size_of(node->left) + find_newline(node->text, line - left_newlines) + 1;
+		} else {
+			line -= left_newlines + node->newlines;
+			offset += size_of(node->left) + node->text.size();
+			node = node->right.get();
+		}
+	}
+	return this->size();
+}
+
+size_t Rope::line_length(size_t line) const
+{
+	size_t start = this->line_start(line);
+	size_t end = line + 1 < this->lines() ? this->line_start(line + 1) - 1 : this->size();
+	return end - start;
+}
+
+size_t Rope::line_of(size_t offset) const
+{
+	size_t line = 0;
+	const Node* node = root.get();
+	while(node) {
+		size_t left_size = size_of(node->left);
+		if(offset < left_size) {
+			node = node->left.get();
+		} else if(offset < left_size + node->text.size()) {
+			return line + newlines_of(node->left) + count_newlines(node->text.substr(0, offset - left_size));
+		} else {
+			line += newlines_of(node->left) + node->newlines;
+			offset -= left_size + node->text.size();
+			node = node->right.get();
+		}
+	}
+	return line;
+}
+
+std::string Rope::str() const
+{
+	std::string out;
+	out.reserve(this->size());
+	this->for_each_piece(0, [&] (strview piece) {
+		out.append(piece.data(), piece.size());
+		return true;
+	});
+	return out;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines Rope, a string which can be edited anywhere in logarithmic
+ * time, and indexed by line.
+ */
+
+#include "base.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * A string stored as a balanced tree of pieces, each referring to (at most
+ * leaf_size) chars of immutable storage.
+ *
+ * Each node also counts the newlines below it, so lines can be found without
+ * scanning the text. Inserting, erasing, and converting between offsets and
+ * lines are all O(log n), for any position.
+ *
+ * Nodes are never modified once made (edits copy the path to the root), so
+ * copying a Rope is O(1), and copies can be read from several threads while
+ * another copy is edited. The text can also be borrowed from elsewhere (e.g. a
+ * memory-mapped file), in which case only edited pieces are copied.
+ *
+ * The tree is a treap (ordered by offset, with random priorities forming a
+ * heap), which keeps it balanced with high probability.
+ */
+struct Rope
+{
+	/// The most chars referred to by each node.
+	static constexpr size_t leaf_size = 1024;
+
+	struct Node
+	{
+		std::shared_ptr<const Node> left, right;
+		std::shared_ptr<const void> storage; // keeps text alive
+		strview text;
+		size_t newlines; // in text
+		size_t total_size, total_newlines; // of the whole subtree
+		std::uint32_t priority; // greater than those of the children
+	};
+	using NodePtr = std::shared_ptr<const Node>;
+
+	NodePtr root; // null if empty
+public:
+	Rope() = default;
+
+	/**
+	 * Refer to \p text instead of copying it, which must stay valid as
+	 * long as \p keep_alive does.
+	 */
+	Rope(strview text, std::shared_ptr<const void> keep_alive);
+
+	size_t size() const { return root ? root->total_size : 0; }
+	bool empty() const { return !root; }
+
+	/**
+	 * Get the number of lines (one more than the number of newlines).
+	 */
+	size_t lines() const { return 1 + (root ? root->total_newlines : 0); }
+
+	/**
+	 * Get the char at \p offset, which must be less than size().
+	 */
+	char at(size_t offset) const;
+
+	/**
+	 * Insert \p text before \p offset (at most size()).
+	 */
+	void insert(size_t offset, strview text);
+
+	/**
+	 * Erase up to \p count chars from \p offset.
+	 */
+	void erase(size_t offset, size_t count);
+
+	/**
+	 * Get the offset of the start of line \p line, or size() if there is no
+	 * such line.
+	 */
+	size_t line_start(size_t line) const;
+
+	/**
+	 * Get the length of line \p line, not including its newline.
+	 */
+	size_t line_length(size_t line) const;
+
+	/**
+	 * Get the line containing \p offset (at most size()).
+	 */
+	size_t line_of(size_t offset) const;
+
+	/**
+	 * Copy the text into a std::string.
+	 */
+	std::string str() const;
+
+	/**
+	 * Call \p func with each piece of the text from \p offset to the end,
+	 * in order. If \p func returns false, no more pieces are visited.
+	 */
+	template <typename F>
+	void for_each_piece(size_t offset, F&& func) const
+	{
+		visit(root.get(), offset, func);
+	}
+
+private:
+	template <typename F>
+	static bool visit(const Node* node, size_t offset, F& func)
+	{
+		if(!node) {
+			return true;
+		}
+		size_t left_size = node->left ? node->left->total_size : 0;
+		if(offset < left_size && !visit(node->left.get(), offset, func)) {
+			return false;
+		}
+		size_t skip = offset > left_size ? offset - left_size : 0;
+		if(skip < node->text.size() && !func(node->text.substr(skip))) {
+			return false;
+		}
+		size_t past = left_size + node->text.size();
+		return visit(node->right.get(), offset > past ? offset - past : 0, func);
+	}
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines Selection, a set of the elements of a stack,
+ * ExtentIndex, which finds the elements of a stack near a rectangle, and
+ * RegionSelection, which uses both to keep the elements drawing in a
+ * rectangle selected as it changes.
+ */
+
+#include "base.hpp"
+#include "canvas.hpp"
+#include "drawable.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A set of the indices of the elements of a stack, stored as one bit per
+ * element, so that adding, removing and testing an element is O(1), and the
+ * indices come out sorted without sorting them.
+ */
+struct Selection
+{
+	std::vector<std::uint64_t> bits;
+	size_t length = 0; // the number of elements there is room for
+	size_t selected = 0;
+public:
+	/**
+	 * Deselect everything, and make room for the elements of a stack with
+	 * \p size elements.
+	 */
+	void reset(size_t size)
+	{
+		bits.assign((size + 63) / 64, 0);
+		length = size;
+		selected = 0;
+	}
+
+	/**
+	 * Get the number of elements there is room for (see reset()).
+	 */
+	size_t size() const
+	{
+		return length;
+	}
+
+	/**
+	 * Get the number of elements selected.
+	 */
+	size_t count() const
+	{
+		return selected;
+	}
+
+	/**
+	 * Return if the element \p id is selected.
+	 */
+	bool has(int id) const
+	{
+		return (bits[id / 64] >> (id % 64)) & 1;
+	}
+
+	/**
+	 * Select the element \p id if \p select is set, otherwise deselect it.
+	 */
+	void set(int id, bool select)
+	{
+		if(this->has(id) == select) {
+			return;
+		}
+		bits[id / 64] ^= 1ull << (id % 64);
+		if(select) {
+			++selected;
+		} else {
+			--selected;
+		}
+	}
+
+	/**
+	 * Get the indices of the elements selected, in order.
+	 */
+	std::vector<int> ids() const
+	{
+		std::vector<int> out;
+		out.reserve(selected);
+		for(size_t word = 0; word < bits.size(); ++word) {
+			// skip whole words of unselected elements at once
+			int id = static_cast<int>(word * 64);
+			for(std::uint64_t rest = bits[word]; rest != 0; rest >>= 1, ++id) {
+				if(rest & 1) {
+					out.push_back(id);
+				}
+			}
+		}
+		return out;
+	}
+};
+
+/**
+ * The extents (see Drawable::extent) of the elements of a stack, listed by
+ * the squares of a coarse grid which they overlap, so that the elements which
+ * might draw in a small rectangle are found without looking at the others.
+ *
+ * Elements with no extent, or which overlap too many squares, are listed
+ * everywhere, so they are always found.
+ */
+struct ExtentIndex
+{
+	static constexpr int square = 32; // the width and height of the squares, in cells
+	static constexpr long long most_squares = 16; // per element, beyond which it's everywhere
+
+	/// The extent of an element, if it is known.
+	struct Extent
+	{
+		point min, max; // inclusive
+		bool known;
+	};
+
+	std::vector<Extent> extents; // for each element
+	std::unordered_map<std::uint64_t, std::vector<int>> squares; // the elements in each square
+	std::vector<int> everywhere;
+public:
+	/**
+	 * Index the elements of \p stack, finding their extents with \p
+	 * canvas.
+	 */
+	void build(const ElementStack& stack, Canvas& canvas)
+	{
+		extents.clear();
+		squares.clear();
+		everywhere.clear();
+		extents.reserve(stack.elements.size());
+
+		for(size_t idx = 0; idx < stack.elements.size(); ++idx) {
+			Extent extent;
+			extent.known = stack.elements[idx]->extent(canvas, extent.min, extent.max);
+			extents.push_back(extent);
+
+			int id = static_cast<int>(idx);
+			if(!extent.known || count(extent.min, extent.max) > most_squares) {
+				everywhere.push_back(id);
+				continue;
+			}
+			for(int y = square_of(extent.min.y); y <= square_of(extent.max.y); ++y) {
+				for(int x = square_of(extent.min.x); x <= square_of(extent.max.x); ++x) {
+					squares[key(x, y)].push_back(id);
+				}
+			}
+		}
+	}
+
+	/**
+	 * Add the elements which might draw in the rectangle from \p min to \p
+	 * max inclusive to \p out, some of them possibly more than once.
+	 * Returns false (adding nothing) if the rectangle covers so many
+	 * squares that it would be quicker to look at every element.
+	 */
+	bool near(point min, point max, std::vector<int>& out) const
+	{
+		if(count(min, max) > static_cast<long long>(extents.size())) {
+			return false;
+		}
+		for(int y = square_of(min.y); y <= square_of(max.y); ++y) {
+			for(int x = square_of(min.x); x <= square_of(max.x); ++x) {
+				auto it = squares.find(key(x, y));
+				if(it != squares.end()) {
+					out.insert(out.end(), it->second.begin(), it->second.end());
+				}
+			}
+		}
+		out.insert(out.end(), everywhere.begin(), everywhere.end());
+		return true;
+	}
+
+private:
+	/**
+	 * Get the square (along one axis) which the cell \p pos is in.
+	 */
+	static int square_of(int pos)
+	{
+		// rounding down, even for negative positions
+		return pos >= 0 ? pos / square : -((-(pos + 1)) / square) - 1;
+	}
+
+	/**
+	 * Get the number of squares overlapped by the rectangle from \p min to
+	 * \p max inclusive.
+	 */
+	static long long count(point min, point max)
+	{
+		long long width = static_cast<long long>(square_of(max.x)) - square_of(min.x) + 1;
+		long long height = static_cast<long long>(square_of(max.y)) - square_of(min.y) + 1;
+		return width * height;
+	}
+
+	static std::uint64_t key(int x, int y)
+	{
+		return static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32 | static_cast<std::uint32_t>(y);
+	}
+};
+
+/**
+ * The elements of a stack which draw in a rectangle, kept along with an
+ * ExtentIndex of the stack so that the rectangle can be resized or moved
+ * by only looking at the elements near where it changed (see
+ * Document::select_region() and Document::reselect_region()).
+ */
+struct RegionSelection
+{
+	Selection selected;
+	ExtentIndex index;
+	point min = { 0, 0 }, max = { -1, -1 }; // the rectangle, inclusive
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+/**
+ * \file
+ * This file defines Sprite, a cached raster of some elements, as well as the
+ * Canvases used to create one.
+ */
+
+#include "base.hpp"
+#include "canvas.hpp"
+#include "cell.hpp"
+#include "lines.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+/**
+ * A rectangular block of cells, where unset cells are Canvas::Transparent.
+ *
+ * This stores what some elements look like when drawn, so that they can be
+ * drawn again later with a simple copy.
+ */
+struct Sprite
+{
+	point min = { 0, 0 }; // position of the top left cell
+	int width = 0, height = 0;
+	std::vector<char> cells; // row-major, width * height
+	std::vector<Pen> pens; // what each cell was drawn with, in the same layout
+	Junctions junctions; // the lines through each cell, so they still join
+public:
+	/**
+	 * Get the start of row \p y (relative to min.y).
+	 */
+	const char* row(int y) const
+	{
+		return cells.data() + static_cast<size_t>(y) * width;
+	}
+
+	/**
+	 * Draw the sprite onto \p canvas, translated by \p offset.
+	 */
+	void draw(Canvas& canvas, point offset = { 0, 0 }) const
+	{
+		for(int y = 0; y < height; ++y) {
+			size_t start = static_cast<size_t>(y) * width;
+			canvas.blit(this->row(y), junctions.row(y), pens.data() + start, width, min.x + offset.x, min.y + y + offset.y);
+		}
+	}
+};
+
+/**
+ * Find the smallest rectangle containing everything drawn.
+ */
+struct BoundsFinder
+	: public Canvas
+{
+	point min = { INT_MAX, INT_MAX };
+	point max = { INT_MIN, INT_MIN }; // inclusive
+public:
+	/**
+	 * Return if nothing has been drawn.
+	 */
+	bool empty() const
+	{
+		return min.x > max.x;
+	}
+
+protected:
+	virtual void impl_set(char /* fill */, int x, int y) override
+	{
+		this->include(x, y, x, y);
+	}
+
+	virtual void impl_linev(char /* fill */, int x, int y1, int y2) override
+	{
+		this->include(x, y1, x, y2);
+	}
+
+	virtual void impl_lineh(char /* fill */, int x1, int y, int x2) override
+	{
+		this->include(x1, y, x2, y);
+	}
+
+	virtual void impl_fill(char /* fill */, int x1, int y1, int x2, int y2) override
+	{
+		this->include(x1, y1, x2, y2);
+	}
+
+	virtual void impl_direct(strview str, int x, int y) override
+	{
+		this->include(x, y, x + static_cast<int>(str.size()) - 1, y);
+	}
+
+	virtual void impl_joinh(const LineGlyphs& /* glyphs */, int x1, int y, int x2) override
+	{
+		this->include(x1, y, x2, y);
+	}
+
+	virtual void impl_joinv(const LineGlyphs& /* glyphs */, int x, int y1, int y2) override
+	{
+		this->include(x, y1, x, y2);
+	}
+
+	void include(int x1, int y1, int x2, int y2)
+	{
+		min.x = std::min(min.x, x1);
+		min.y = std::min(min.y, y1);
+		max.x = std::max(max.x, x2);
+		max.y = std::max(max.y, y2);
+	}
+};
+
+/**
+ * Draw into a Sprite covering a fixed rectangle. Anything outside of that
+ * rectangle is ignored. Lines are joined up within the sprite, and keep their
+ * shapes when it is drawn, but don't join with those it is drawn over.
+ */
+struct SpriteRenderer
+	: public Canvas
+{
+	Sprite& sprite;
+public:
+	/**
+	 * Reset \p target to cover (\p x1, \p y1) to (\p x2, \p y2) inclusive,
+	 * with every cell Transparent. The corners must already be ordered.
+	 */
+	SpriteRenderer(Sprite& target, int x1, int y1, int x2, int y2)
+		: sprite(target)
+	{
+		sprite.min = { x1, y1 };
+		sprite.width = x2 - x1 + 1;
+		sprite.height = y2 - y1 + 1;
+		sprite.cells.assign(static_cast<size_t>(sprite.width) * sprite.height, Transparent);
+		sprite.pens.assign(sprite.cells.size(), 0);
+		sprite.junctions.reset(sprite.width, sprite.height);
+		this->set_visible(x1, y1, x2, y2);
+	}
+
+protected:
+	virtual void impl_set(char fill, int x, int y) override
+	{
+		x -= sprite.min.x;
+		y -= sprite.min.y;
+		if(0 <= x && x < sprite.width && 0 <= y && y < sprite.height) {
+			sprite.cells[static_cast<size_t>(y) * sprite.width + x] = fill;
+			sprite.pens[static_cast<size_t>(y) * sprite.width + x] = pen;
+			sprite.junctions.clear(x, y, 1);
+		}
+	}
+
+	virtual void impl_lineh(char fill, int x1, int y, int x2) override
+	{
+		y -= sprite.min.y;
+		x1 = std::max(x1 - sprite.min.x, 0);
+		x2 = std::min(x2 - sprite.min.x, sprite.width - 1);
+		if(y < 0 || sprite.height <= y || x1 > x2) {
+			return;
+		}
+		size_t start = static_cast<size_t>(y) * sprite.width;
+		std::fill(sprite.cells.begin() + start + x1, sprite.cells.begin() + start + x2 + 1, fill);
+		std::fill(sprite.pens.begin() + start + x1, sprite.pens.begin() + start + x2 + 1, pen);
+		sprite.junctions.clear(x1, y, x2 - x1 + 1);
+	}
+
+	virtual void impl_joinh(const LineGlyphs& glyphs, int x1, int y, int x2) override
+	{
+		sprite.junctions.joinh(sprite.cells.data(), glyphs, pen, x1 - sprite.min.x, y - sprite.min.y, x2 - sprite.min.x);
+		this->paint(x1, y, x2, y);
+	}
+
+	virtual void impl_joinv(const LineGlyphs& glyphs, int x, int y1, int y2) override
+	{
+		sprite.junctions.joinv(sprite.cells.data(), glyphs, pen, x - sprite.min.x, y1 - sprite.min.y, y2 - sprite.min.y);
+		this->paint(x, y1, x, y2);
+	}
+
+	/**
+	 * Set the pen of the cells from (\p x1, \p y1) to (\p x2, \p y2)
+	 * inclusive (if in the sprite) to the current one.
+	 */
+	void paint(int x1, int y1, int x2, int y2)
+	{
+		x1 = std::max(x1 - sprite.min.x, 0);
+		x2 = std::min(x2 - sprite.min.x, sprite.width - 1);
+		y1 = std::max(y1 - sprite.min.y, 0);
+		y2 = std::min(y2 - sprite.min.y, sprite.height - 1);
+		for(int y = y1; y <= y2 && x1 <= x2; ++y) {
+			auto begin = sprite.pens.begin() + static_cast<size_t>(y) * sprite.width;
+			std::fill(begin + x1, begin + x2 + 1, pen);
+		}
+	}
+};
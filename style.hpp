@@ -9,16 +9,30 @@
 #include "base.hpp"
 
 #include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+/**
+ * A flag marking something as out of date, e.g. a cached drawing.
+ *
+ * This is shared (through weak_ptrs) with every Style the owner depends on,
+ * which will set it when they are modified.
+ */
+struct StaleFlag
+{
+	bool stale = false;
+};
+
 /**
  * An interface for styles for Drawable.
  *
- * This specifies which characters to draw a Drawable with. This is handled
- * throughout the project using shared_ptrs, which are managed by a
- * StyleManager.
+ * This specifies which characters to draw a Drawable with. Styles are stored
+ * in a StyleTable (owned by a StyleManager), and referred to by StyleId.
  *
  * Derived types should have the default constructor initialize the style to
  * the default configuration (not empty/null/unspecified).
@@ -26,34 +40,262 @@
 struct Style
 {
 	/**
-	 * Define a set of style part and their corresponding display position,
-	 * used for the style popup dialog.  The char* does not need to be
-	 * unique, though point does. The top-left corner (which contains the
-	 * first item) should be (1, 1).
+	 * Incremented whenever the style is modified, so that anything cached
+	 * using the style can tell if it is out of date.
+	 */
+	unsigned version = 0;
+
+	/**
+	 * Everything depending on this style, which need to be marked stale
+	 * when it is modified. Expired entries are removed lazily.
+	 */
+	mutable std::vector<std::weak_ptr<StaleFlag>> dependents;
+public:
+	Style() = default;
+
+	// copies are separate styles, so they don't have any dependents
+	Style(const Style& other)
+		: version(other.version), dependents()
+	{
+	}
+
+	Style& operator=(const Style& /* other */)
+	{
+		this->touch(); // the content is replaced
+		return *this;
+	}
+
+	/**
+	 * Mark the style as modified. This must be called after changing any
+	 * part of the style, and marks all dependents as stale.
+	 */
+	void touch()
+	{
+		++version;
+		for(auto& weak : dependents) {
+			if(auto flag = weak.lock()) {
+				flag->stale = true;
+			}
+		}
+		dependents.clear(); // they need to register again once updated
+	}
+
+	/**
+	 * Register \p flag to be marked stale when this style is modified.
+	 */
+	void add_dependent(const std::shared_ptr<StaleFlag>& flag) const
+	{
+		if(dependents.size() == dependents.capacity()) {
+			// drop expired entries before reallocating
+			auto expired = [] (const std::weak_ptr<StaleFlag>& weak) { return weak.expired(); };
+			dependents.erase(std::remove_if(dependents.begin(), dependents.end(), expired), dependents.end());
+		}
+		dependents.push_back(flag);
+	}
+};
+
+/**
+ * The colour and weight to draw an element with: the low 4 bits are the colour
+ * (0 for the default, otherwise one more than the curses colour number), and
+ * pen_bold is set for bold.
+ */
+using Pen = std::uint8_t;
+
+constexpr Pen pen_bold = 0x10;
+
+/**
+ * Get the Pen for the colour part of a style, \p colour. This is one of
+ * "krgybmcw" (black, red, green, yellow, blue, magenta, cyan, white, in the
+ * order of the curses colours), or the same in upper case for bold. Anything
+ * else is the default colour.
+ */
+constexpr Pen pen_of(char colour)
+{
+	const char* names = "krgybmcw";
+	for(int idx = 0; idx < 8; ++idx) {
+		if(colour == names[idx]) {
+			return static_cast<Pen>(idx + 1);
+		} else if(colour == names[idx] - 'a' + 'A') {
+			return static_cast<Pen>((idx + 1) | pen_bold);
+		}
+	}
+	return 0;
+}
+
+/**
+ * Describes a single part of a style of type \p T, i.e. one of its chars.
+ *
+ * Each style type defines a constexpr static method parts(), returning an
+ * array of these. This is used for the style popup dialog, as well as for
+ * comparing and saving styles. The member does not need to be unique, though
+ * pos does. The top-left corner (which contains the first item) should be
+ * (1, 1).
+ */
+template <typename T>
+struct StylePart
+{
+	char T::* member;
+	point pos; // display position
+};
+
+/**
+ * The parts of the style type \p T, as returned by T::parts().
+ */
+template <typename T>
+constexpr auto style_parts = T::parts();
+
+/**
+ * Get the maximum x and y values of the display positions of \p T.
+ *
+ * This finds the upper limit of the points, to determine the space needed to
+ * draw the item.
+ */
+template <typename T>
+constexpr point style_display_range()
+{
+	point max = { 0, 0 };
+	for(size_t idx = 0; idx < style_parts<T>.size(); ++idx) {
+		const point& pos = style_parts<T>[idx].pos;
+		max.x = max.x < pos.x ? pos.x : max.x;
+		max.y = max.y < pos.y ? pos.y : max.y;
+	}
+	return max;
+}
+
+/**
+ * A reference to a style of type \p T in a StyleTable.
+ *
+ * Elements hold these instead of pointers to styles, so they are small and
+ * cheap to copy.
+ */
+template <typename T>
+struct StyleId
+{
+	std::uint32_t value;
+public:
+	bool operator==(StyleId other) const { return value == other.value; }
+	bool operator!=(StyleId other) const { return value != other.value; }
+};
+
+/**
+ * Storage for all styles of type \p T in a document, referred to by StyleId.
+ *
+ * Styles are never removed, and their addresses are stable. Styles can be
+ * deduplicated by content using intern().
+ */
+template <typename T>
+struct StyleTable
+{
+	std::deque<T> styles;
+	std::deque<std::string> keys; // the content_key() of each style, as indexed
+	std::unordered_multimap<std::string, StyleId<T>> index; // by content, for intern()
+public:
+	/**
+	 * Access the style with id \p id.
+	 */
+	T& operator[](StyleId<T> id)
+	{
+		return styles[id.value];
+	}
+
+	const T& operator[](StyleId<T> id) const
+	{
+		return styles[id.value];
+	}
+
+	/**
+	 * The number of styles in the table.
+	 */
+	size_t size() const
+	{
+		return styles.size();
+	}
+
+	/**
+	 * Add a copy of \p style, even if an identical style already exists.
+	 */
+	StyleId<T> add(const T& style)
+	{
+		StyleId<T> id{ static_cast<std::uint32_t>(styles.size()) };
+		styles.push_back(style);
+		keys.push_back(content_key(style));
+		index.emplace(keys.back(), id);
+		return id;
+	}
+
+	/**
+	 * Find a style with the same content as \p style (the earliest, if
+	 * there are several), adding it if none exists.
+	 */
+	StyleId<T> intern(const T& style)
+	{
+		auto found = index.equal_range(content_key(style));
+		if(found.first == found.second) {
+			return this->add(style);
+		}
+		StyleId<T> earliest = found.first->second;
+		for(auto it = found.first; it != found.second; ++it) {
+			if(it->second.value < earliest.value) {
+				earliest = it->second;
+			}
+		}
+		return earliest;
+	}
+
+	/**
+	 * Mark the style \p id as modified. This must be called after any of
+	 * its parts are changed.
+	 */
+	void modified(StyleId<T> id)
+	{
+		// move the index entry, looking only at styles with the old content
+		std::string& key = keys[id.value];
+		auto found = index.equal_range(key);
+		for(auto it = found.first; it != found.second; ++it) {
+			if(it->second == id) {
+				index.erase(it);
+				break;
+			}
+		}
+		key = content_key(styles[id.value]);
+		index.emplace(key, id);
+		styles[id.value].touch();
+	}
+
+	/**
+	 * Get a string uniquely identifying the parts of \p style.
 	 */
-	std::vector<std::pair<char*, point>> get_display_points()
+	static std::string content_key(const T& style)
 	{
-		return {};
+		std::string key;
+		for(auto& part : style_parts<T>) {
+			key.push_back(style.*part.member);
+		}
+		return key;
 	}
 };
 
 /**
  * A manager for several styles for a single Drawable.
  *
- * This contains several styles of a single type. This class also provides
- * several other methods which are useful when developing a graphical
- * interface.
+ * This contains several styles of a single type, stored in a StyleTable. This
+ * class also provides several other methods which are useful when developing
+ * a graphical interface.
  */
 template <typename T>
 struct StyleManager
 {
-	std::vector<std::shared_ptr<T>> styles;
+	using style_type = T;
+
+	StyleTable<T> table;
+	std::vector<StyleId<T>> styles; // in display order
 public:
 	/**
 	 * Constructs the object with one style, the default style.
 	 */
 	StyleManager()
-		: styles(1, std::make_shared<T>()) // default first
+		: table()
+		, styles(1, table.add(T{})) // default first
 	{
 	}
 
@@ -63,51 +305,42 @@ public:
 	 * The first style is canonically the default one, which is used for
 	 * new Drawables.
 	 */
-	std::shared_ptr<T> get_first() const
+	StyleId<T> get_first() const
 	{
 		return styles.front();
 	}
 
 	/**
-	 * Duplicate the first style and put the copy at the front.
-	 *
-	 * This copies the first (default) style and allows that to be modified
-	 * separately.
+	 * Access the first style itself. Call modified_first() after changing
+	 * it.
 	 */
-	void duplicate_first()
+	T& first_style()
 	{
-		styles.emplace_back(std::make_shared<T>(*this->get_first()));
-		this->unshift();
+		return table[this->get_first()];
 	}
 
 	/**
-	 * Return the display point mapping for the first style.
-	 *
-	 * This simply calls Style::get_display_points() on the first style.
+	 * Mark the first style as modified.
 	 */
-	std::vector<std::pair<char*, point>> get_display_points() const
+	void modified_first()
 	{
-		return this->get_first()->get_display_points();
+		table.modified(this->get_first());
 	}
 
 	/**
-	 * Returns the maximum x and y values for the display range.
+	 * Duplicate the first style and put the copy at the front.
 	 *
-	 * This finds the upper limit of the points, to determine the space
-	 * needed to draw the item.
+	 * This copies the first (default) style and allows that to be modified
+	 * separately.
 	 */
-	point get_display_range() const
+	void duplicate_first()
 	{
-		point max = { 0, 0 };
-		for(auto pair : this->get_display_points()) {
-			max.x = std::max(max.x, pair.second.x);
-			max.y = std::max(max.y, pair.second.y);
-		}
-		return max;
+		styles.push_back(table.add(table[this->get_first()]));
+		this->unshift();
 	}
 
 	/**
-	 * Rotate the styles to make the 2nd be first.
+	 * Rotate the styles to make the last be first.
 	 */
 	void shift()
 	{
@@ -115,7 +348,7 @@ public:
 	}
 
 	/**
-	 * Rotate the styles to make the last be first.
+	 * Rotate the styles to make the 2nd be first.
 	 */
 	void unshift()
 	{
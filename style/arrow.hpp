@@ -1,7 +1,10 @@
 #pragma once
 
+#include "../lines.hpp"
 #include "../style.hpp"
 
+#include <array>
+
 struct ArrowStyle
 	: public Style
 {
@@ -15,20 +18,33 @@ struct ArrowStyle
 	// what to put on markers
 	char marker = 0;
 
-	std::vector<std::pair<char*, point>> get_display_points()
+	// the colour to draw the arrow in (see pen_of())
+	char colour = 0;
+
+	/**
+	 * Get the glyphs to draw the lines of an arrow with, where lines
+	 * which meet in three or four directions are joined with a '+'.
+	 */
+	LineGlyphs lines() const
+	{
+		return {{ vertical, horizontal, tl, tr, bl, br, '+' }};
+	}
+
+	static constexpr std::array<StylePart<ArrowStyle>, 12> parts()
 	{
-		return {
-			{ &tl,         point(1, 1) },
-			{ &up,         point(2, 1) },
-			{ &tr,         point(3, 1) },
-			{ &left,       point(1, 2) },
-			{ &marker,     point(2, 2) },
-			{ &right,      point(3, 2) },
-			{ &bl,         point(1, 3) },
-			{ &down,       point(2, 3) },
-			{ &br,         point(3, 3) },
-			{ &vertical,   point(5, 1) },
-			{ &horizontal, point(5, 3) },
-		};
+		return {{
+			{ &ArrowStyle::tl,         point(1, 1) },
+			{ &ArrowStyle::up,         point(2, 1) },
+			{ &ArrowStyle::tr,         point(3, 1) },
+			{ &ArrowStyle::left,       point(1, 2) },
+			{ &ArrowStyle::marker,     point(2, 2) },
+			{ &ArrowStyle::right,      point(3, 2) },
+			{ &ArrowStyle::bl,         point(1, 3) },
+			{ &ArrowStyle::down,       point(2, 3) },
+			{ &ArrowStyle::br,         point(3, 3) },
+			{ &ArrowStyle::vertical,   point(5, 1) },
+			{ &ArrowStyle::horizontal, point(5, 3) },
+			{ &ArrowStyle::colour,     point(5, 2) },
+		}};
 	}
 };
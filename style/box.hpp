@@ -1,7 +1,10 @@
 #pragma once
 
+#include "../lines.hpp"
 #include "../style.hpp"
 
+#include <array>
+
 struct BoxStyle
 	: public Style
 {
@@ -13,18 +16,43 @@ struct BoxStyle
 	// what to fill the box (with spaces)
 	char fill = 0;
 
-	std::vector<std::pair<char*, point>> get_display_points()
+	// the colour to draw the box in (see pen_of())
+	char colour = 0;
+
+	/**
+	 * Get the glyphs to draw a side with, where the side itself is drawn
+	 * with \p horizontal or \p vertical.
+	 *
+	 * Transparent corners are drawn as the vertical side next to them,
+	 * or the horizontal one if that is also transparent. Where other lines
+	 * meet a side, the cell is a '+'.
+	 */
+	LineGlyphs lines(char horizontal, char vertical) const
 	{
-		return {
-			{ &tl_corner, point(1, 1) },
-			{ &tside,     point(2, 1) },
-			{ &tr_corner, point(3, 1) },
-			{ &lside,     point(1, 2) },
-			{ &fill,      point(2, 2) },
-			{ &rside,     point(3, 2) },
-			{ &bl_corner, point(1, 3) },
-			{ &bside,     point(2, 3) },
-			{ &br_corner, point(3, 3) },
+		auto either = [] (char first, char second, char third) {
+			return first ? first : second ? second : third;
 		};
+		return {{
+			vertical, horizontal,
+			either(tl_corner, lside, tside), either(tr_corner, rside, tside),
+			either(bl_corner, lside, bside), either(br_corner, rside, bside),
+			'+'
+		}};
+	}
+
+	static constexpr std::array<StylePart<BoxStyle>, 10> parts()
+	{
+		return {{
+			{ &BoxStyle::tl_corner, point(1, 1) },
+			{ &BoxStyle::tside,     point(2, 1) },
+			{ &BoxStyle::tr_corner, point(3, 1) },
+			{ &BoxStyle::lside,     point(1, 2) },
+			{ &BoxStyle::fill,      point(2, 2) },
+			{ &BoxStyle::rside,     point(3, 2) },
+			{ &BoxStyle::bl_corner, point(1, 3) },
+			{ &BoxStyle::bside,     point(2, 3) },
+			{ &BoxStyle::br_corner, point(3, 3) },
+			{ &BoxStyle::colour,    point(5, 2) },
+		}};
 	}
 };